@@ -0,0 +1,36 @@
+#include "alloc_count.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+  std::atomic<uint64_t> num_allocations = 0;
+  std::atomic<uint64_t> num_bytes = 0;
+} // End unnamed namespace.
+
+alloc_count::counts alloc_count::snapshot() {
+  return {
+    num_allocations.load(std::memory_order_relaxed),
+    num_bytes.load(std::memory_order_relaxed),
+  };
+}
+
+// The other replaceable forms of `new` and `delete` call these by default. They are exported so
+// that allocations made inside shared libraries are counted too.
+__attribute__((visibility("default"))) void* operator new(std::size_t size) {
+  num_allocations.fetch_add(1, std::memory_order_relaxed);
+  num_bytes.fetch_add(size, std::memory_order_relaxed);
+  if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+__attribute__((visibility("default"))) void operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+
+__attribute__((visibility("default"))) void operator delete(void* ptr, std::size_t) noexcept {
+  std::free(ptr);
+}
@@ -0,0 +1,19 @@
+#ifndef ALLOC_COUNT_H
+#define ALLOC_COUNT_H
+
+#include <cstdint>
+
+// Counts of the calls to the global `operator new` since the program started, which the benchmark
+// binary replaces. The difference between two snapshots is what the code between them allocated.
+namespace alloc_count {
+
+struct counts {
+  uint64_t allocations;
+  uint64_t bytes;
+};
+
+counts snapshot();
+
+} // End `alloc_count` namespace.
+
+#endif
@@ -0,0 +1,139 @@
+#include "corpus.hpp"
+
+#include <cmath>
+#include <random>
+#include <fmt/core.h>
+
+namespace corpus {
+
+namespace {
+
+constexpr std::array short_names = {"x", "y", "i", "n", "acc", "lhs", "rhs", "tmp", "step"};
+constexpr std::array operators = {"+", "-", "*", "/"};
+
+// Each of these lexes to at least one invalid token.
+constexpr std::array malformed = {
+  "0x_", "0xg", "0b102", "0o9", "1__000", "12abc", "3.", "1e", "1.2.3", "1.5p3", "$", "@", "#", "`",
+};
+
+class generator {
+public:
+  generator(uint64_t seed) : rng(seed) {}
+
+  void identifiers(std::string& out) {
+    if (rng() % 4 == 0) {
+      out += fmt::format("def {}({} {})\n  ", name(), name(), name());
+    }
+    const int num_terms = 2 + rng() % 6;
+    for (int i = 0; i < num_terms; i++) {
+      out += fmt::format("{} {} ", name(), operators[rng() % operators.size()]);
+    }
+    out += name();
+    out += '\n';
+  }
+
+  void literals(std::string& out) {
+    const int num_literals = 2 + rng() % 6;
+    for (int i = 0; i < num_literals; i++) {
+      const uint64_t value = rng() >> (rng() % 60);
+      switch (rng() % 6) {
+        case 0:
+          out += fmt::format("{}", value % 1000);
+          break;
+        case 1:
+          out += fmt::format("{}_{:03}_{:03}", value % 1000, rng() % 1000, rng() % 1000);
+          break;
+        case 2:
+          out += fmt::format("0x{:x}", value);
+          break;
+        case 3:
+          out += fmt::format("0b{:b}", value % 0x10000);
+          break;
+        case 4:
+          out += fmt::format("{}", real());
+          break;
+        default:
+          out += fmt::format("{:a}", real());
+          break;
+      }
+      out += i + 1 < num_literals ? " + " : "\n";
+    }
+  }
+
+  void comments(std::string& out) {
+    const int indent = 2 * (rng() % 5);
+    if (rng() % 8 == 0) {
+      out += fmt::format("{:{}}// {:=<{}}\n", "", indent, "", 60 + rng() % 20);
+      return;
+    }
+    out += fmt::format("{:{}}//", "", indent);
+    const int num_words = 3 + rng() % 12;
+    for (int i = 0; i < num_words; i++) {
+      out += ' ';
+      out += short_names[rng() % short_names.size()];
+    }
+    out += '\n';
+  }
+
+  void nesting(std::string& out) {
+    const int depth = 8 + rng() % 57;
+    out.append(depth, '(');
+    out += name();
+    for (int i = 0; i < depth; i++) {
+      (out += fmt::format
+        (" {} {})",
+         operators[rng() % operators.size()], short_names[rng() % short_names.size()]));
+    }
+    out += '\n';
+  }
+
+  void errors(std::string& out) {
+    const int num_errors = 1 + rng() % 4;
+    for (int i = 0; i < num_errors; i++) {
+      out += fmt::format("{} {} ", malformed[rng() % malformed.size()], name());
+    }
+    out += '\n';
+  }
+
+private:
+  std::mt19937_64 rng;
+
+  std::string name() {
+    if (rng() % 2 == 0) {
+      return short_names[rng() % short_names.size()];
+    }
+    return fmt::format("{}_value_{}", short_names[rng() % short_names.size()], rng() % 10000);
+  }
+
+  double real() {
+    return std::ldexp(double(rng() >> 11), -int(rng() % 80));
+  }
+};
+
+} // End unnamed namespace.
+
+std::string generate(const mix& weights, size_t size, uint64_t seed) {
+  const unsigned total =
+    weights.identifiers + weights.literals + weights.comments + weights.nesting + weights.errors;
+  generator gen(seed);
+  std::mt19937_64 pick(seed);
+  std::string out;
+  out.reserve(size + 1024);
+  while (out.size() < size) {
+    unsigned roll = pick() % total;
+    if (roll < weights.identifiers) {
+      gen.identifiers(out);
+    } else if ((roll -= weights.identifiers) < weights.literals) {
+      gen.literals(out);
+    } else if ((roll -= weights.literals) < weights.comments) {
+      gen.comments(out);
+    } else if ((roll -= weights.comments) < weights.nesting) {
+      gen.nesting(out);
+    } else {
+      gen.errors(out);
+    }
+  }
+  return out;
+}
+
+} // End `corpus` namespace.
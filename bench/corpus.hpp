@@ -0,0 +1,40 @@
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Synthetic sources for benchmarks. A corpus is a random sequence of fragments of a few kinds, and
+// the weights of a `mix` control how often each kind is picked. The same mix, size, and seed always
+// give the same text, so numbers from different commits are measured on the same input.
+namespace corpus {
+
+struct mix {
+  unsigned identifiers = 0; // Expressions and definitions over long and short names.
+  unsigned literals = 0;    // Integers and floats in every radix, with and without separators.
+  unsigned comments = 0;    // Indented line comments and banners.
+  unsigned nesting = 0;     // Expressions nested dozens of parentheses deep.
+  unsigned errors = 0;      // Malformed literals and characters that start no token.
+};
+
+struct preset {
+  std::string_view name;
+  mix weights;
+};
+
+constexpr std::array presets = {
+  preset{"identifier-heavy", {.identifiers = 16, .literals = 2, .comments = 1, .nesting = 1}},
+  preset{"literal-heavy", {.identifiers = 2, .literals = 16, .comments = 1, .nesting = 1}},
+  preset{"comment-heavy", {.identifiers = 3, .literals = 1, .comments = 16}},
+  preset{"deeply-parenthesized", {.identifiers = 2, .literals = 1, .nesting = 16}},
+  preset{"error-dense", {.identifiers = 4, .literals = 4, .comments = 1, .errors = 8}},
+};
+
+// At least `size` bytes of source, ending with a newline.
+std::string generate(const mix& weights, size_t size, uint64_t seed = 42);
+
+} // End `corpus` namespace.
+
+#endif
@@ -0,0 +1,1070 @@
+// Lexer throughput benchmarks. These are only meaningful in a release build:
+//   cmake -S . -B build -DCMAKE_BUILD_TYPE=Release && cmake --build build --target kal-bench
+// To compare two commits, diff the output of `build/kal-bench --json` built at each of them.
+#include "alloc_count.hpp"
+#include "ast.hpp"
+#include "corpus.hpp"
+#include "flat_ast.hpp"
+#include "keywords.hpp"
+#include "module.hpp"
+#include "lexer.hpp"
+#include "num_lit_value.hpp"
+#include "parallel_lexer.hpp"
+#include "parser.hpp"
+#include "scan.hpp"
+#include "stream.hpp"
+#include "token.hpp"
+#include "token_dump.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <span>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <fmt/core.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr int num_trials = 5;
+
+// Make the compiler assume that `value` is read, so that the work that computed it is not dropped
+// from a timed loop whose result is otherwise unused.
+template <typename T> void do_not_optimize(const T& value) {
+  asm volatile("" : : "g"(value) : "memory");
+}
+
+// Generated sources are dominated by indentation, blank lines, and comment banners.
+std::string whitespace_heavy_corpus(size_t size) {
+  std::mt19937 rng(42);
+  std::string out;
+  out.reserve(size + 256);
+  while (out.size() < size) {
+    switch (rng() % 4) {
+      case 0:
+        out += "// " + std::string(77, '=') + "\n";
+        break;
+      case 1:
+        out += "\n\n";
+        break;
+      case 2:
+        out += std::string(4 * (1 + rng() % 6), ' ') + "// generated: do not edit\n";
+        break;
+      default:
+        out += std::string(4 * (1 + rng() % 6), ' ') + "(a + b) * c - d / 2\n";
+        break;
+    }
+  }
+  return out;
+}
+
+// Long generated identifiers such as `__tmp_reg_000123` joined by operators.
+std::string identifier_heavy_corpus(size_t size) {
+  std::mt19937 rng(42);
+  std::string out;
+  out.reserve(size + 256);
+  while (out.size() < size) {
+    out += fmt::format("__tmp_reg_{:06} + ", rng() % 1000000);
+    if (rng() % 8 == 0) {
+      out += fmt::format("generated_value_{}_{}\n", rng() % 100, rng() % 100);
+    }
+  }
+  return out;
+}
+
+// Numeric data files: tables of hex floats along with decimal floats and separated integers.
+std::string numeric_heavy_corpus(size_t size) {
+  std::mt19937_64 rng(42);
+  std::uniform_real_distribution<double> dist(-1e6, 1e6);
+  std::string out;
+  out.reserve(size + 256);
+  while (out.size() < size) {
+    for (int col = 0; col < 4; col++) {
+      out += fmt::format("{:a} ", std::abs(dist(rng)));
+    }
+    out += fmt::format("{:e} {}_{:03} 0x{:04x}_{:04x}\n",
+                       dist(rng), rng() % 1000, rng() % 1000, rng() % 0x10000, rng() % 0x10000);
+  }
+  return out;
+}
+
+fs::path write_corpus(const std::string& name, const std::string& text) {
+  fs::path path = fs::temp_directory_path() / fmt::format("kal-bench-{}.kal", name);
+  std::ofstream(path, std::ios::binary) << text;
+  return path;
+}
+
+// Return the fastest of `num_trials` runs of lexing `file` from start to end, in seconds.
+double time_lexing(module::file& file) {
+  double best = std::numeric_limits<double>::max();
+  for (int trial = 0; trial < num_trials; trial++) {
+    auto begin = std::chrono::steady_clock::now();
+    lexer lex(file);
+    while (lex.next_token().kind != token::type::eof) {}
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+    best = std::min(best, elapsed.count());
+  }
+  return best;
+}
+
+// Return the fastest of `num_trials` builds of a line table for `file`, in seconds.
+double time_line_table(const module::file& file) {
+  double best = std::numeric_limits<double>::max();
+  for (int trial = 0; trial < num_trials; trial++) {
+    auto begin = std::chrono::steady_clock::now();
+    module::line_table lines(file.start(), file.size());
+    lines.size();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+    best = std::min(best, elapsed.count());
+  }
+  return best;
+}
+
+// Lex `text` and build its line table with the kernels for every instruction set that the CPU
+// supports.
+void bench_kernels(const std::string& name, const std::string& text) {
+  const fs::path path = write_corpus(name, text);
+  module::file file(path);
+  const double mb = text.size() / 1e6;
+  fmt::print("{} corpus ({:.1f} MB)\n", name, mb);
+  double scalar_secs = 0;
+  for (auto level : {scan::isa::scalar, scan::isa::sse2, scan::isa::avx2, scan::isa::avx512}) {
+    if (level > scan::detected_isa()) {
+      continue;
+    }
+    scan::use_isa(level);
+    double secs = time_lexing(file);
+    if (level == scan::isa::scalar) {
+      scalar_secs = secs;
+    }
+    (fmt::print
+      ("  {:<8} {:>9.1f} MB/s  {:>5.2f}x  line table {:>9.1f} MB/s\n",
+       scan::isa_name(level), mb / secs, scalar_secs / secs, mb / time_line_table(file)));
+  }
+  scan::use_isa(scan::detected_isa());
+  fs::remove(path);
+}
+
+// The times that a run in a child process reports, and the peak resident set size of the child.
+struct child_result {
+  std::array<double, 2> secs;
+  double peak_rss_mb;
+};
+
+// Run `fn`, which returns two times in seconds, in a child process so that its peak resident set
+// size is measured in isolation.
+template <typename F> child_result run_in_child(F fn) {
+  child_result result = {{0, 0}, 0};
+  int fds[2];
+  if (pipe(fds) != 0) {
+    return result;
+  }
+  const pid_t child = fork();
+  if (child == 0) {
+    close(fds[0]);
+    const std::array<double, 2> secs = fn();
+    write(fds[1], secs.data(), sizeof(secs));
+    _exit(EXIT_SUCCESS);
+  }
+  close(fds[1]);
+  read(fds[0], result.secs.data(), sizeof(result.secs));
+  close(fds[0]);
+  int status;
+  struct rusage usage;
+  wait4(child, &status, 0, &usage);
+  result.peak_rss_mb = usage.ru_maxrss / 1024.0;
+  return result;
+}
+
+// Load and lex a large file once per load mode, and once through a streaming window.
+void bench_loading(std::string text) {
+  const fs::path path = write_corpus("loading", text);
+  fmt::print("loading ({:.1f} MB)\n", text.size() / 1e6);
+  // A child inherits the resident pages of its parent.
+  std::string().swap(text);
+  for (const char* mode : {"mapped", "buffered", "streamed"}) {
+    const child_result result = run_in_child([&] {
+      std::array<double, 2> secs = {0, 0};
+      auto begin = std::chrono::steady_clock::now();
+      if (mode == std::string_view("streamed")) {
+        // A stream loads while it lexes.
+        module::stream source(path);
+        source.lex([](const module::stream::batch&) {});
+        secs[1] = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+      } else {
+        const auto load_mode =
+          mode == std::string_view("mapped")
+            ? module::file::load_mode::mapped
+            : module::file::load_mode::buffered;
+        module::file file(path, load_mode);
+        auto loaded = std::chrono::steady_clock::now();
+        lexer lex(file);
+        while (lex.next_token().kind != token::type::eof) {}
+        auto lexed = std::chrono::steady_clock::now();
+        secs[0] = std::chrono::duration<double>(loaded - begin).count();
+        secs[1] = std::chrono::duration<double>(lexed - begin).count();
+      }
+      return secs;
+    });
+    (fmt::print
+      ("  {:<8} load {:>8.2f} ms  load+lex {:>8.2f} ms  peak RSS {:>7.1f} MB\n",
+       mode, result.secs[0] * 1e3, result.secs[1] * 1e3, result.peak_rss_mb));
+  }
+  fs::remove(path);
+}
+
+// One expression of about `size` bytes, balanced so that its tree is shallow: sums and products of
+// parenthesized terms over names and literals.
+std::string expression_corpus(size_t size) {
+  std::mt19937_64 rng(44);
+  auto build = [&](auto& self, size_t budget, std::string& out) -> void {
+    if (budget < 32) {
+      out += fmt::format("(name_{} * {})", rng() % 1000, rng() % 100);
+      return;
+    }
+    out += '(';
+    self(self, budget / 2, out);
+    out += rng() % 2 ? " + " : " / ";
+    self(self, budget / 2, out);
+    out += ')';
+  };
+  std::string out;
+  out.reserve(size + 256);
+  build(build, size, out);
+  out += '\n';
+  return out;
+}
+
+// A sum of `size / 4096` independent expressions of 4 KB each, like a module of many definitions.
+std::string top_level_corpus(size_t size) {
+  std::string out;
+  out.reserve(size + 8192);
+  while (out.size() < size) {
+    std::string term = expression_corpus(4096);
+    term.pop_back();
+    out += out.empty() ? "" : " - ";
+    out += term;
+  }
+  out += '\n';
+  return out;
+}
+
+// Parse one large expression with every token lexed before parsing, and with tokens pulled from
+// the lexer as the parser needs them. Each run is in its own process to measure its peak memory.
+void bench_parse_memory(std::string text) {
+  const fs::path path = write_corpus("parse", text);
+  fmt::print("parse memory ({:.1f} MB)\n", text.size() / 1e6);
+  std::string().swap(text);
+  for (bool stream_tokens : {false, true}) {
+    const child_result result = run_in_child([&] {
+      auto begin = std::chrono::steady_clock::now();
+      module::file file(path);
+      parsing::parser(file, {.stream_tokens = stream_tokens}).parse();
+      auto parsed = std::chrono::steady_clock::now();
+      file.abs_syntax.reset();
+      auto freed = std::chrono::steady_clock::now();
+      return std::array<double, 2>{
+        std::chrono::duration<double>(parsed - begin).count(),
+        std::chrono::duration<double>(freed - parsed).count(),
+      };
+    });
+    (fmt::print
+      ("  {:<9} load+parse {:>8.2f} ms  free {:>7.2f} ms  peak RSS {:>7.1f} MB\n",
+       stream_tokens ? "streamed" : "batched", result.secs[0] * 1e3, result.secs[1] * 1e3,
+       result.peak_rss_mb));
+  }
+  fs::remove(path);
+}
+
+// Return the fastest of `num_trials` runs of `fn`, in seconds.
+template <typename F> double best_time(F fn) {
+  double best = std::numeric_limits<double>::max();
+  for (int trial = 0; trial < num_trials; trial++) {
+    auto begin = std::chrono::steady_clock::now();
+    fn();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+    best = std::min(best, elapsed.count());
+  }
+  return best;
+}
+
+// Lex and parse a source of many top-level terms with as many threads for each. The speedup is
+// bounded by the number of hardware threads, and with one it shows the cost of splitting and
+// joining chunks.
+void bench_parse_threads(const std::string& text) {
+  const fs::path path = write_corpus("parse_threads", text);
+  module::file file(path);
+  const double mb = text.size() / 1e6;
+  const unsigned max_threads = std::max(4u, std::thread::hardware_concurrency());
+  (fmt::print
+    ("parallel parsing ({:.1f} MB, {} hardware threads)\n",
+     mb, std::thread::hardware_concurrency()));
+  double one_thread_secs = 0;
+  for (unsigned num_threads = 1; num_threads <= max_threads; num_threads *= 2) {
+    const parsing::options opts = {.lex_threads = num_threads, .parse_threads = num_threads};
+    const double secs = best_time([&] { parsing::parser(file, opts).parse(); });
+    if (num_threads == 1) {
+      one_thread_secs = secs;
+    }
+    (fmt::print
+      ("  {:>3} threads {:>9.2f} ms {:>9.1f} MB/s  {:>5.2f}x\n",
+       num_threads, secs * 1e3, mb / secs, one_thread_secs / secs));
+  }
+  fs::remove(path);
+}
+
+// Parse one expression of normal shape, and expressions nested a million deep as generated code
+// can be, which overflowed the native stack when the parser was recursive.
+void bench_parse_depth() {
+  constexpr size_t depth = 1'000'000;
+  std::string negated;
+  for (size_t i = 0; i < depth; i++) {
+    negated += "- ";
+  }
+  negated += "1\n";
+  const std::pair<std::string_view, std::string> inputs[] = {
+    {"balanced", expression_corpus(16 << 20)},
+    {"parenthesized", std::string(depth, '(') + "1" + std::string(depth, ')') + "\n"},
+    {"negated", std::move(negated)},
+  };
+  fmt::print("parse depth\n");
+  for (const auto& [name, text] : inputs) {
+    const fs::path path = write_corpus("depth", text);
+    module::file file(path);
+    const double secs = best_time([&] { parsing::parser(file).parse(); });
+    (fmt::print
+      ("  {:<14} {:>6.1f} MB {:>9.2f} ms {:>8.1f} MB/s\n",
+       name, text.size() / 1e6, secs * 1e3, text.size() / 1e6 / secs));
+    fs::remove(path);
+  }
+}
+
+// Balance a sum of a million terms, as generated code can have, which the parser makes a million
+// nodes deep.
+void bench_rebalance() {
+  constexpr size_t num_terms = 1'000'000;
+  std::string text = "x0";
+  for (size_t i = 1; i < num_terms; i++) {
+    text += i % 2 ? fmt::format(" + {}", i) : fmt::format(" + x{}", i % 1000);
+  }
+  text += '\n';
+  const fs::path path = write_corpus("chain", text);
+  module::file file(path);
+  auto height = [](const ast::tree& tree) {
+    const ast::flat_tree nodes = ast::flatten(tree.root);
+    std::vector<uint32_t> heights(nodes.size());
+    for (size_t i = 0; i < nodes.size(); i++) {
+      for (ast::node_index child : nodes.children[i]) {
+        if (child != ast::no_node) {
+          heights[i] = std::max(heights[i], heights[child] + 1);
+        }
+      }
+    }
+    return heights.back() + 1;
+  };
+  const double parse_secs = best_time([&] { parsing::parser(file).parse(); });
+  const uint32_t parsed_height = height(*file.abs_syntax);
+  const double rebalance_secs = best_time([&] {
+    parsing::parser(file).parse();
+    ast::rebalance(*file.abs_syntax, ast::reassociation::integers);
+  });
+  fmt::print("rebalancing ({} terms)\n", num_terms);
+  (fmt::print
+    ("  parse            {:>8.2f} ms  height {}\n", parse_secs * 1e3, parsed_height));
+  (fmt::print
+    ("  parse+rebalance  {:>8.2f} ms  height {}\n",
+     rebalance_secs * 1e3, height(*file.abs_syntax)));
+  fs::remove(path);
+}
+
+// The time to update the tree of a source of `num_lines` lines after a one-character edit in its
+// middle, compared with parsing it again from scratch.
+void bench_reparse(size_t num_lines) {
+  std::string text = "x";
+  std::mt19937_64 rng(45);
+  for (size_t i = 0; i < num_lines; i++) {
+    text += fmt::format("\n  + (name_{} * {} - y) / 2", rng() % 1000, rng() % 10);
+  }
+  text += '\n';
+  const fs::path path = write_corpus("reparse", text);
+  module::file file(path);
+  const parsing::options opts = {.symbols = std::make_shared<interner>()};
+  const double full_secs = best_time([&] { parsing::parser(file, opts).parse(); });
+  // Each trial changes a digit and then changes it back, so every trial edits the same source.
+  const uint32_t digit = text.find(" * ", text.size() / 2) + 3;
+  const std::string_view old_digit(text.data() + digit, 1);
+  uint32_t num_parsed = 0;
+  const double reparse_secs = best_time([&] {
+    num_parsed = parsing::parser(file, opts).reparse({digit, 1, old_digit == "7" ? "8" : "7"});
+    parsing::parser(file, opts).reparse({digit, 1, old_digit});
+  }) / 2;
+  fmt::print("incremental reparsing ({} lines, {:.1f} MB)\n", num_lines, text.size() / 1e6);
+  fmt::print("  full parse       {:>8.3f} ms\n", full_secs * 1e3);
+  (fmt::print
+    ("  reparse          {:>8.3f} ms  {:.0f}x faster, {} tokens parsed\n",
+     reparse_secs * 1e3, full_secs / reparse_secs, num_parsed));
+  fs::remove(path);
+}
+
+// Compare the nodes of one large expression as the parser makes them, in an arena, with the same
+// nodes as a flat tree: their size, the time to convert between them, and the time to walk each.
+void bench_flat_tree(const std::string& text) {
+  const fs::path path = write_corpus("flat", text);
+  module::file file(path);
+  parsing::parser(file).parse();
+  const ast::tree& tree = *file.abs_syntax;
+  ast::flat_tree nodes = ast::flatten(tree.root);
+
+  const double flatten_secs = best_time([&] { nodes = ast::flatten(tree.root); });
+  const double copy_secs = best_time([&] {
+    ast::flat_tree copy = nodes;
+    do_not_optimize(copy.size());
+  });
+  const double unflatten_secs = best_time([&] {
+    ast::arena rebuilt;
+    do_not_optimize(ast::unflatten(nodes, rebuilt)->main_token);
+  });
+  // Both walks visit the lhs of a node before its rhs and sum the main tokens.
+  const double pointer_walk_secs = best_time([&] {
+    uint64_t sum = 0;
+    std::vector<const ast::node*> pending = {tree.root};
+    while (!pending.empty()) {
+      const ast::node* cur = pending.back();
+      pending.pop_back();
+      sum += cur->main_token;
+      if (cur->type == ast::node_type::binop_expr) {
+        pending.push_back(static_cast<const ast::binop_expr*>(cur)->rhs);
+        pending.push_back(static_cast<const ast::binop_expr*>(cur)->lhs);
+      } else if (cur->type == ast::node_type::unop_expr) {
+        pending.push_back(static_cast<const ast::unop_expr*>(cur)->operand);
+      }
+    }
+    do_not_optimize(sum);
+  });
+  const double index_walk_secs = best_time([&] {
+    uint64_t sum = 0;
+    std::vector<ast::node_index> pending = {nodes.root()};
+    while (!pending.empty()) {
+      const ast::node_index cur = pending.back();
+      pending.pop_back();
+      sum += nodes.main_tokens[cur];
+      for (int i = 1; i >= 0; i--) {
+        if (nodes.children[cur][i] != ast::no_node) {
+          pending.push_back(nodes.children[cur][i]);
+        }
+      }
+    }
+    do_not_optimize(sum);
+  });
+
+  fmt::print("flat trees ({:.1f} MB, {} nodes)\n", text.size() / 1e6, nodes.size());
+  (fmt::print
+    ("  arena {:>7.1f} MB  flat {:>7.1f} MB  {:.1f}x smaller\n",
+     tree.nodes.capacity() / 1e6, nodes.num_bytes() / 1e6,
+     double(tree.nodes.capacity()) / nodes.num_bytes()));
+  fmt::print("  flatten          {:>8.2f} ms\n", flatten_secs * 1e3);
+  fmt::print("  copy flat        {:>8.2f} ms\n", copy_secs * 1e3);
+  fmt::print("  unflatten        {:>8.2f} ms\n", unflatten_secs * 1e3);
+  fmt::print("  walk pointers    {:>8.2f} ms\n", pointer_walk_secs * 1e3);
+  fmt::print("  walk indices     {:>8.2f} ms\n", index_walk_secs * 1e3);
+  fs::remove(path);
+}
+
+// Report the memory used by the token arrays that the parser keeps for `text`.
+void bench_token_memory(const std::string& text) {
+  const fs::path path = write_corpus("tokens", text);
+  module::file file(path);
+  std::vector<token::type> tokens;
+  std::vector<module::span> token_locs;
+  lexer lex(file);
+  token cur;
+  do {
+    cur = lex.next_token();
+    tokens.push_back(cur.kind);
+    token_locs.push_back(cur.loc);
+  } while (cur.kind != token::type::eof);
+  tokens.shrink_to_fit();
+  token_locs.shrink_to_fit();
+
+  // The size of a span that is a pair of addresses, for comparison.
+  constexpr size_t address_span_size = 2 * sizeof(const char*);
+  const size_t num_bytes =
+    tokens.size() * sizeof(token::type) + token_locs.size() * sizeof(module::span);
+  const size_t num_address_bytes = tokens.size() * (sizeof(token::type) + address_span_size);
+  fmt::print("token memory ({:.1f} MB, {} tokens)\n", text.size() / 1e6, tokens.size());
+  (fmt::print
+    ("  offset spans   {:>2} bytes/token {:>8.1f} MB\n",
+     sizeof(token::type) + sizeof(module::span), num_bytes / 1e6));
+  (fmt::print
+    ("  address spans  {:>2} bytes/token {:>8.1f} MB\n",
+     sizeof(token::type) + address_span_size, num_address_bytes / 1e6));
+  fs::remove(path);
+}
+
+// Integer literals in every radix, most of them with separators, as in tables of constants.
+std::string int_heavy_corpus(size_t size) {
+  std::mt19937_64 rng(42);
+  std::string out;
+  out.reserve(size + 256);
+  while (out.size() < size) {
+    const uint64_t value = rng() >> (rng() % 48);
+    (out += fmt::format
+      ("{} 0x{:x} 0o{:o} {}_{:03}_{:03} 0b{:b}\n",
+       value, value, value % 0x1000000, value % 1000, rng() % 1000, rng() % 1000, value % 0x10000));
+  }
+  return out;
+}
+
+// The value of the integer literal [lo, hi), decoded one character at a time as a later pass over
+// the tokens would without the decoding that the lexer does.
+uint64_t decode_int_bytewise(const char* lo, const char* hi) {
+  uint64_t radix = 10;
+  if (hi - lo >= 2 && lo[0] == '0' && (lo[1] | 0x20) != '_' && !std::isdigit(lo[1])) {
+    radix = (lo[1] | 0x20) == 'x' ? 16 : (lo[1] | 0x20) == 'o' ? 8 : 2;
+    lo += 2;
+  }
+  uint64_t value = 0;
+  for (; lo < hi; lo++) {
+    if (*lo != '_') {
+      value = value * radix + (std::isdigit(*lo) ? *lo - '0' : (*lo | 0x20) - 'a' + 10);
+    }
+  }
+  return value;
+}
+
+// Time lexing `text`, which now includes decoding its integer literals, against decoding them in a
+// separate pass over the tokens afterwards.
+void bench_int_decoding(const std::string& text) {
+  const fs::path path = write_corpus("ints", text);
+  module::file file(path);
+  std::vector<module::span> int_locs;
+  lexer lex(file);
+  for (token cur = lex.next_token(); cur.kind != token::type::eof; cur = lex.next_token()) {
+    if (cur.kind == token::type::int_literal) {
+      int_locs.push_back(cur.loc);
+    }
+  }
+  auto time_pass = [&](auto decode) {
+    double best = std::numeric_limits<double>::max();
+    for (int trial = 0; trial < num_trials; trial++) {
+      uint64_t sum = 0;
+      auto begin = std::chrono::steady_clock::now();
+      for (const auto& loc : int_locs) {
+        sum += decode(file.start() + loc.lo, file.start() + loc.hi());
+      }
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+      do_not_optimize(sum);
+      best = std::min(best, elapsed.count());
+    }
+    return best;
+  };
+  const double bytewise_secs = time_pass(decode_int_bytewise);
+  const double swar_secs = time_pass([](const char* lo, const char* hi) {
+    return *num_lit::decode_int(lo, hi);
+  });
+  const double lex_secs = time_lexing(file);
+  fmt::print("int literals ({:.1f} MB, {} literals)\n", text.size() / 1e6, int_locs.size());
+  fmt::print("  lex, decoding while scanning   {:>8.2f} ms\n", lex_secs * 1e3);
+  fmt::print("  separate pass, bytewise        {:>8.2f} ms\n", bytewise_secs * 1e3);
+  fmt::print("  separate pass, SWAR            {:>8.2f} ms\n", swar_secs * 1e3);
+  fs::remove(path);
+}
+
+// Float literals as they appear in numeric code: short constants, shortest round-trip output of
+// random doubles with separators, and hex floats.
+std::string float_heavy_corpus(size_t size) {
+  std::mt19937_64 rng(43);
+  std::uniform_real_distribution<double> unit(0, 1);
+  std::string out;
+  out.reserve(size + 256);
+  while (out.size() < size) {
+    const double value = unit(rng) * std::pow(10.0, int(rng() % 40) - 20);
+    (out += fmt::format
+      ("{}.{} {:.17e} 1_000.{:03}_5 {:a}\n",
+       rng() % 100, rng() % 1000, value, rng() % 1000, value));
+  }
+  return out;
+}
+
+// Time converting the float literals of `text` with `num_lit::decode_float` against `strtod`, and
+// against `std::from_chars` where the standard library has it. The last two need a copy of each
+// literal without separators or a hex prefix.
+void bench_float_decoding(const std::string& text) {
+  const fs::path path = write_corpus("floats", text);
+  module::file file(path);
+  std::vector<module::span> float_locs;
+  std::vector<std::string> plain;
+  lexer lex(file);
+  for (token cur = lex.next_token(); cur.kind != token::type::eof; cur = lex.next_token()) {
+    if (cur.kind == token::type::float_literal) {
+      float_locs.push_back(cur.loc);
+      std::string literal(file.start() + cur.loc.lo, cur.loc.len);
+      std::erase(literal, '_');
+      plain.push_back(std::move(literal));
+    }
+  }
+  auto time_pass = [&](auto decode) {
+    double best = std::numeric_limits<double>::max();
+    for (int trial = 0; trial < num_trials; trial++) {
+      double sum = 0;
+      auto begin = std::chrono::steady_clock::now();
+      for (size_t i = 0; i < float_locs.size(); i++) {
+        sum += decode(i);
+      }
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+      do_not_optimize(sum);
+      best = std::min(best, elapsed.count());
+    }
+    return best;
+  };
+  const double decode_secs = time_pass([&](size_t i) {
+    const char* lo = file.start() + float_locs[i].lo;
+    return num_lit::decode_float(lo, lo + float_locs[i].len);
+  });
+  const double strtod_secs = time_pass([&](size_t i) {
+    return std::strtod(plain[i].c_str(), nullptr);
+  });
+  fmt::print("float literals ({:.1f} MB, {} literals)\n", text.size() / 1e6, float_locs.size());
+  fmt::print("  decode_float                   {:>8.2f} ms\n", decode_secs * 1e3);
+  fmt::print("  strtod                         {:>8.2f} ms\n", strtod_secs * 1e3);
+#if defined(__cpp_lib_to_chars)
+  const double from_chars_secs = time_pass([&](size_t i) {
+    const std::string& literal = plain[i];
+    const bool hex = literal.size() > 2 && (literal[1] | 0x20) == 'x';
+    const char* lo = literal.data() + (hex ? 2 : 0);
+    double value = 0;
+    std::from_chars(lo, literal.data() + literal.size(), value,
+                    hex ? std::chars_format::hex : std::chars_format::general);
+    return value;
+  });
+  fmt::print("  std::from_chars                {:>8.2f} ms\n", from_chars_secs * 1e3);
+#endif
+  fs::remove(path);
+}
+
+// Time writing the tokens of `text` to a token file and loading them back, against lexing `text`.
+// Loading includes touching every token, since a mapped file is only read as it is used.
+void bench_token_dump(const std::string& text) {
+  const fs::path path = write_corpus("dump", text);
+  const fs::path dump_path = fs::temp_directory_path() / "kal-bench-dump.ktok";
+  module::file file(path);
+  std::vector<token::type> tokens;
+  std::vector<module::span> token_locs;
+  lexer lex(file);
+  token cur;
+  do {
+    cur = lex.next_token();
+    tokens.push_back(cur.kind);
+    token_locs.push_back(cur.loc);
+  } while (cur.kind != token::type::eof);
+
+  double write_secs = std::numeric_limits<double>::max();
+  double load_secs = std::numeric_limits<double>::max();
+  for (int trial = 0; trial < num_trials; trial++) {
+    auto begin = std::chrono::steady_clock::now();
+    token_dump::write(dump_path, tokens, token_locs);
+    auto written = std::chrono::steady_clock::now();
+    token_dump::reader dump(dump_path);
+    uint64_t sum = 0;
+    for (size_t i = 0; i < dump.tokens().size(); i++) {
+      sum += dump.tokens()[i] + dump.token_locs()[i].len;
+    }
+    do_not_optimize(sum);
+    auto loaded = std::chrono::steady_clock::now();
+    write_secs = std::min(write_secs, std::chrono::duration<double>(written - begin).count());
+    load_secs = std::min(load_secs, std::chrono::duration<double>(loaded - written).count());
+  }
+  fmt::print("token dump ({:.1f} MB, {} tokens)\n", text.size() / 1e6, tokens.size());
+  fmt::print("  lex                            {:>8.2f} ms\n", time_lexing(file) * 1e3);
+  fmt::print("  write token file               {:>8.2f} ms\n", write_secs * 1e3);
+  fmt::print("  load token file                {:>8.2f} ms\n", load_secs * 1e3);
+  fs::remove(dump_path);
+  fs::remove(path);
+}
+
+// Time re-lexing after a one-character edit in the middle of `text`, as an editor does on every
+// keystroke, against lexing all of `text` again.
+void bench_relexing(const std::string& text) {
+  const fs::path path = write_corpus("relexing", text);
+  module::file file(path);
+  std::vector<token::type> tokens;
+  std::vector<module::span> token_locs;
+  lexer lex(file);
+  token cur;
+  do {
+    cur = lex.next_token();
+    tokens.push_back(cur.kind);
+    token_locs.push_back(cur.loc);
+  } while (cur.kind != token::type::eof);
+  file.line_offsets.size();
+
+  constexpr int num_edits = 1000;
+  const uint32_t middle = text.size() / 2;
+  auto begin = std::chrono::steady_clock::now();
+  for (int i = 0; i < num_edits; i++) {
+    relex(file, {middle, 0, "x"}, tokens, token_locs);
+    relex(file, {middle, 1, ""}, tokens, token_locs);
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+  fmt::print("relexing ({:.1f} MB, {} tokens)\n", text.size() / 1e6, tokens.size());
+  fmt::print("  one-character edit {:>9.1f} us\n", elapsed.count() / (2 * num_edits) * 1e6);
+  fmt::print("  whole file         {:>9.1f} us\n", time_lexing(file) * 1e6);
+  fs::remove(path);
+}
+
+// Find the positions of the errors and of all tokens of `text` one span at a time, as each error
+// once did when it was marked, and with one pass over the line table.
+void bench_positions(const std::string& text) {
+  const fs::path path = write_corpus("positions", text);
+  module::file file(path);
+  lex_chunk chunk(file.start(), file.start() + file.size(), true);
+  chunk.lex();
+  std::vector<module::span> error_locs;
+  for (const auto& [kind, loc] : chunk.errors) {
+    error_locs.push_back(loc);
+  }
+  file.line_offsets.size();
+
+  (fmt::print
+    ("positions ({:.1f} MB, {} errors, {} tokens)\n",
+     text.size() / 1e6, error_locs.size(), chunk.token_locs.size()));
+  for (const auto& [name, locs] : {
+         std::pair{"errors", std::span<const module::span>(error_locs)},
+         std::pair{"tokens", std::span<const module::span>(chunk.token_locs)}}) {
+    double single_secs = std::numeric_limits<double>::max();
+    double batch_secs = std::numeric_limits<double>::max();
+    std::vector<module::file_pos> found;
+    for (int trial = 0; trial < num_trials; trial++) {
+      found.clear();
+      auto begin = std::chrono::steady_clock::now();
+      uint64_t sum = 0;
+      for (const module::span& loc : locs) {
+        const module::file_pos pos(file, loc);
+        sum += pos.line_no + pos.col_no;
+      }
+      do_not_optimize(sum);
+      auto singles_done = std::chrono::steady_clock::now();
+      module::positions(file, locs, found);
+      auto batch_done = std::chrono::steady_clock::now();
+      (single_secs = std::min
+        (single_secs, std::chrono::duration<double>(singles_done - begin).count()));
+      (batch_secs = std::min
+        (batch_secs, std::chrono::duration<double>(batch_done - singles_done).count()));
+    }
+    fmt::print("  {} one at a time  {:>8.2f} ms\n", name, single_secs * 1e3);
+    fmt::print("  {} in one pass    {:>8.2f} ms\n", name, batch_secs * 1e3);
+  }
+  fs::remove(path);
+}
+
+// Lex `text` in chunks on an increasing number of threads, up to the number of hardware threads.
+void bench_threads(const std::string& text) {
+  const fs::path path = write_corpus("threads", text);
+  module::file file(path);
+  const double mb = text.size() / 1e6;
+  const unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+  fmt::print("parallel lexing ({:.1f} MB, {} hardware threads)\n", mb, max_threads);
+  std::vector<token::type> tokens;
+  std::vector<module::span> token_locs;
+  std::vector<uint32_t> ident_hashes;
+  std::vector<uint64_t> literal_values;
+  double one_thread_secs = 0;
+  for (unsigned num_threads = 1; num_threads <= max_threads; num_threads *= 2) {
+    double best = std::numeric_limits<double>::max();
+    for (int trial = 0; trial < num_trials; trial++) {
+      tokens.clear();
+      token_locs.clear();
+      auto begin = std::chrono::steady_clock::now();
+      (lex_parallel
+        (file, file.size(), num_threads, 1 << 20,
+         tokens, token_locs, ident_hashes, literal_values));
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+      best = std::min(best, elapsed.count());
+    }
+    if (num_threads == 1) {
+      one_thread_secs = best;
+    }
+    (fmt::print
+      ("  {:>3} threads {:>9.1f} MB/s  {:>5.2f}x\n",
+       num_threads, mb / best, one_thread_secs / best));
+  }
+  fs::remove(path);
+}
+
+// The lookup that gperf generated for `def` and `extern` before the keyword table was built at
+// compile time. It hashed by length alone. Kept as the baseline for the current keyword list.
+token::type gperf_get_token(const char* str, size_t len) {
+  static constexpr unsigned char lengthtable[] = {0, 0, 0, 3, 0, 0, 6};
+  static constexpr keywords::entry wordlist[] = {
+    {"", token::type::ident}, {"", token::type::ident}, {"", token::type::ident},
+    {"def", token::type::keyword_def},
+    {"", token::type::ident}, {"", token::type::ident},
+    {"extern", token::type::keyword_extern},
+  };
+  if (len <= 6 && len >= 3) {
+    const unsigned key = len;
+    if (len == lengthtable[key]) {
+      const char* s = wordlist[key].name.data();
+      if (*str == *s && !std::memcmp(str + 1, s + 1, len - 1)) {
+        return wordlist[key].kind;
+      }
+    }
+  }
+  return token::type::ident;
+}
+
+// Keyword lists of any size for the comparison across keyword counts. The i-th word is 3 to 8
+// bytes long and differs from the others in its first or last byte.
+template <size_t N> constexpr auto make_synthetic_names() {
+  std::array<std::array<char, 9>, N> names{};
+  for (size_t i = 0; i < N; i++) {
+    const size_t len = 3 + i % 6;
+    std::fill_n(names[i].begin(), len, 'k');
+    names[i][0] = 'a' + i % 26;
+    names[i][len - 1] = 'a' + i / 26 % 26;
+  }
+  return names;
+}
+
+template <size_t N> inline constexpr auto synthetic_names = make_synthetic_names<N>();
+
+template <size_t N> constexpr auto make_synthetic_list() {
+  std::array<keywords::entry, N> list{};
+  for (size_t i = 0; i < N; i++) {
+    list[i] = {std::string_view(synthetic_names<N>[i].data(), 3 + i % 6), token::type::keyword_def};
+  }
+  return list;
+}
+
+template <size_t N> inline constexpr auto synthetic_list = make_synthetic_list<N>();
+
+// A million identifiers as the lexer would see them, one in four of which is a keyword.
+std::vector<std::string_view>
+keyword_workload(const keywords::entry* list, size_t num_keywords, std::string& storage) {
+  std::mt19937 rng(42);
+  std::vector<std::pair<size_t, size_t>> bounds;
+  storage.clear();
+  for (int i = 0; i < 1000000; i++) {
+    const size_t lo = storage.size();
+    if (rng() % 4 == 0) {
+      storage += list[rng() % num_keywords].name;
+    } else {
+      const size_t len = 1 + rng() % 16;
+      for (size_t j = 0; j < len; j++) {
+        storage += "abcdefghijklmnopqrstuvwxyz_"[rng() % 27];
+      }
+    }
+    bounds.push_back({lo, storage.size() - lo});
+    storage += ' ';
+  }
+  storage += '\0';
+  std::vector<std::string_view> words;
+  for (auto [lo, len] : bounds) {
+    words.emplace_back(storage.data() + lo, len);
+  }
+  return words;
+}
+
+// Return the fastest of `num_trials` runs of looking up every word, in nanoseconds per word.
+template <typename Lookup>
+double time_lookup(const std::vector<std::string_view>& words, Lookup&& lookup) {
+  double best = std::numeric_limits<double>::max();
+  for (int trial = 0; trial < num_trials; trial++) {
+    unsigned num_keywords = 0;
+    auto begin = std::chrono::steady_clock::now();
+    for (auto word : words) {
+      num_keywords += lookup(word.data(), word.size()) != token::type::ident;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+    do_not_optimize(num_keywords);
+    best = std::min(best, elapsed.count());
+  }
+  return best / words.size() * 1e9;
+}
+
+// Compare the perfect hash table for a list of `N` keywords with the usual alternatives.
+template <size_t N> void bench_keyword_count() {
+  static constexpr keywords::table<N> table(synthetic_list<N>);
+  static_assert(table.collision_free);
+  const auto& list = synthetic_list<N>;
+  std::string storage;
+  const auto words = keyword_workload(list.data(), N, storage);
+
+  std::unordered_map<std::string_view, token::type> map;
+  for (const auto& keyword : list) {
+    map.emplace(keyword.name, keyword.kind);
+  }
+  auto sorted = list;
+  (std::sort
+    (sorted.begin(), sorted.end(),
+     [](const auto& a, const auto& b) { return a.name < b.name; }));
+
+  const double hashed = time_lookup(words, [&](const char* str, size_t len) {
+    return table.find(str, len);
+  });
+  const double mapped = time_lookup(words, [&](const char* str, size_t len) {
+    auto iter = map.find(std::string_view(str, len));
+    return iter == map.end() ? token::type::ident : iter->second;
+  });
+  const double searched = time_lookup(words, [&](const char* str, size_t len) {
+    const std::string_view word(str, len);
+    auto iter = (std::lower_bound
+      (sorted.begin(), sorted.end(), word,
+       [](const auto& keyword, std::string_view word) { return keyword.name < word; }));
+    return iter != sorted.end() && iter->name == word ? iter->kind : token::type::ident;
+  });
+  fmt::print("  {:>8} {:>12.2f} ns {:>12.2f} ns {:>12.2f} ns\n", N, hashed, mapped, searched);
+}
+
+// Time keyword lookups with the compile-time table against the gperf table that it replaced, and
+// against other lookups as the number of keywords grows. gperf is no longer part of the build, so
+// it can only be compared for the current list.
+void bench_keywords() {
+  std::string storage;
+  const auto words = keyword_workload(keywords::list.data(), keywords::list.size(), storage);
+  fmt::print("keyword lookup ({} words, 1 in 4 a keyword)\n", words.size());
+  (fmt::print
+    ("  current list  gperf {:.2f} ns  perfect hash {:.2f} ns\n",
+     time_lookup(words, gperf_get_token), time_lookup(words, keywords::get_token)));
+  (fmt::print
+    ("  {:>8} {:>15} {:>15} {:>15}\n",
+     "keywords", "perfect hash", "unordered_map", "binary search"));
+  bench_keyword_count<2>();
+  bench_keyword_count<8>();
+  bench_keyword_count<32>();
+  bench_keyword_count<128>();
+}
+
+// The result of lexing one generated corpus through `lexer<T>::next_token`.
+struct suite_result {
+  std::string_view corpus;
+  size_t num_bytes;
+  size_t num_tokens; // Excluding the end of file.
+  double secs;       // The fastest of `num_trials` runs.
+  alloc_count::counts allocs; // Made by one run, including those for reported errors.
+};
+
+suite_result measure_lexing(std::string_view name, const std::string& text) {
+  const fs::path path = write_corpus(std::string(name), text);
+  suite_result result{name, text.size(), 0, std::numeric_limits<double>::max(), {0, 0}};
+  for (int trial = 0; trial < num_trials; trial++) {
+    // A file keeps the errors that are reported to it, so every run gets a fresh one. It is
+    // buffered so that its pages are resident before the clock starts.
+    module::file file(path, module::file::load_mode::buffered);
+    const alloc_count::counts allocs_before = alloc_count::snapshot();
+    auto begin = std::chrono::steady_clock::now();
+    lexer lex(file);
+    size_t num_tokens = 0;
+    while (lex.next_token().kind != token::type::eof) {
+      num_tokens += 1;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+    const alloc_count::counts allocs_after = alloc_count::snapshot();
+    result.num_tokens = num_tokens;
+    result.secs = std::min(result.secs, elapsed.count());
+    result.allocs = {
+      allocs_after.allocations - allocs_before.allocations,
+      allocs_after.bytes - allocs_before.bytes,
+    };
+  }
+  fs::remove(path);
+  return result;
+}
+
+// Lex a corpus of `size` bytes for every preset mix. The results are printed as JSON, so that the
+// output of two commits can be diffed, or as a table.
+void bench_suite(size_t size, bool json) {
+  std::vector<suite_result> results;
+  for (const corpus::preset& preset : corpus::presets) {
+    results.push_back(measure_lexing(preset.name, corpus::generate(preset.weights, size)));
+  }
+  if (!json) {
+    (fmt::print
+      ("lexer suite ({:.1f} MB per corpus, {})\n",
+       size / 1e6, scan::isa_name(scan::detected_isa())));
+    for (const suite_result& res : results) {
+      (fmt::print
+        ("  {:<21} {:>8.1f} MB/s {:>7.1f} Mtokens/s {:>6.2f} ns/token {:>7} allocs\n",
+         res.corpus, res.num_bytes / res.secs / 1e6, res.num_tokens / res.secs / 1e6,
+         res.secs * 1e9 / res.num_tokens, res.allocs.allocations));
+    }
+    return;
+  }
+  fmt::print("{{\n");
+  fmt::print("  \"isa\": \"{}\",\n", scan::isa_name(scan::detected_isa()));
+  fmt::print("  \"trials\": {},\n", num_trials);
+  fmt::print("  \"corpora\": [\n");
+  for (size_t i = 0; i < results.size(); i++) {
+    const suite_result& res = results[i];
+    fmt::print("    {{\n");
+    fmt::print("      \"name\": \"{}\",\n", res.corpus);
+    fmt::print("      \"bytes\": {},\n", res.num_bytes);
+    fmt::print("      \"tokens\": {},\n", res.num_tokens);
+    fmt::print("      \"mb_per_sec\": {:.1f},\n", res.num_bytes / res.secs / 1e6);
+    fmt::print("      \"tokens_per_sec\": {:.0f},\n", res.num_tokens / res.secs);
+    fmt::print("      \"ns_per_token\": {:.3f},\n", res.secs * 1e9 / res.num_tokens);
+    fmt::print("      \"allocations\": {},\n", res.allocs.allocations);
+    fmt::print("      \"allocated_bytes\": {}\n", res.allocs.bytes);
+    fmt::print("    }}{}\n", i + 1 < results.size() ? "," : "");
+  }
+  fmt::print("  ]\n");
+  fmt::print("}}\n");
+}
+} // End unnamed namespace.
+
+
+// With `--json`, only the lexer suite is run, and its results are the only output. `--size` sets
+// the size of each of its corpora in MB.
+int main(int argc, char** argv) {
+  bool json = false;
+  size_t suite_size = 32 << 20;
+  for (int i = 1; i < argc; i++) {
+    const std::string_view arg = argv[i];
+    if (arg == "--json") {
+      json = true;
+    } else if (arg.starts_with("--size=") && std::atoi(argv[i] + 7) > 0) {
+      suite_size = size_t(std::atoi(argv[i] + 7)) << 20;
+    } else {
+      fmt::print(stderr, "usage: {} [--json] [--size=<MB>]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  bench_suite(suite_size, json);
+  if (json) {
+    return EXIT_SUCCESS;
+  }
+
+  bench_kernels("whitespace-heavy", whitespace_heavy_corpus(64 << 20));
+  bench_kernels("identifier-heavy", identifier_heavy_corpus(64 << 20));
+  bench_kernels("numeric-heavy", numeric_heavy_corpus(64 << 20));
+  bench_keywords();
+  bench_int_decoding(int_heavy_corpus(64 << 20));
+  bench_float_decoding(float_heavy_corpus(16 << 20));
+  bench_token_memory(identifier_heavy_corpus(64 << 20));
+  bench_token_dump(identifier_heavy_corpus(64 << 20));
+  bench_relexing(identifier_heavy_corpus(1 << 20));
+  bench_threads(identifier_heavy_corpus(256 << 20));
+  const auto error_dense = std::find_if
+    (corpus::presets.begin(), corpus::presets.end(),
+     [](const corpus::preset& cur) { return cur.name == "error-dense"; });
+  bench_positions(corpus::generate(error_dense->weights, 32 << 20));
+  bench_loading(numeric_heavy_corpus(256 << 20));
+  bench_parse_memory(expression_corpus(16 << 20));
+  bench_parse_depth();
+  bench_parse_threads(top_level_corpus(64 << 20));
+  bench_flat_tree(expression_corpus(16 << 20));
+  bench_rebalance();
+  bench_reparse(50'000);
+  return EXIT_SUCCESS;
+}
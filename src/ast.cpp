@@ -1,14 +1,76 @@
 #include "ast.hpp"
 #include "ast_pretty_printer.hpp"
+#include "flat_ast.hpp"
+#include "parser.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <fmt/core.h>
+#include <span>
 
 namespace ast {
 
+arena::arena(arena&& other) noexcept
+  : blocks(std::move(other.blocks)),
+    next(std::exchange(other.next, nullptr)),
+    end(std::exchange(other.end, nullptr)),
+    num_bytes(std::exchange(other.num_bytes, 0)) {}
+
+arena& arena::operator=(arena&& other) noexcept {
+  blocks = std::move(other.blocks);
+  next = std::exchange(other.next, nullptr);
+  end = std::exchange(other.end, nullptr);
+  num_bytes = std::exchange(other.num_bytes, 0);
+  return *this;
+}
+
+size_t arena::capacity() const { return num_bytes; }
+
+// Nodes are still made in the current block, or in the last block of `other` if there is none.
+void arena::splice(arena&& other) {
+  if (!next) {
+    next = other.next;
+    end = other.end;
+  }
+  (blocks.insert
+    (blocks.end(), std::make_move_iterator(other.blocks.begin()),
+     std::make_move_iterator(other.blocks.end())));
+  num_bytes += other.num_bytes;
+  other.blocks.clear();
+  other.next = nullptr;
+  other.end = nullptr;
+  other.num_bytes = 0;
+}
+
+void arena::add_block(size_t min_size) {
+  const size_t block_size =
+    std::max(min_size, blocks.empty() ? first_block_size : std::min(2 * num_bytes, max_block_size));
+  blocks.push_back(std::make_unique_for_overwrite<std::byte[]>(block_size));
+  next = blocks.back().get();
+  end = next + block_size;
+  num_bytes += block_size;
+}
+
+void literal_table::push_back(token_index idx, uint64_t value) {
+  tokens.push_back(idx);
+  values.push_back(value);
+}
+
+uint64_t literal_table::int_value(token_index idx) const {
+  return values[std::lower_bound(tokens.begin(), tokens.end(), idx) - tokens.begin()];
+}
+
+double literal_table::float_value(token_index idx) const {
+  return std::bit_cast<double>(int_value(idx));
+}
+
 bool operator==(const tree& lhs, const tree& rhs) {
   return ((!lhs.root && !rhs.root) || (lhs.root && rhs.root && *lhs.root == *rhs.root)) &&
          lhs.tokens == rhs.tokens &&
          lhs.token_locs == rhs.token_locs;
 }
 
+#if !defined(DOCTEST_CONFIG_DISABLE)
 doctest::String toString(const tree& tree) {
   std::string str;
   pretty_printer pp(tree, std::back_inserter(str));
@@ -18,6 +80,108 @@ doctest::String toString(const tree& tree) {
   // string's contents.
   return str.c_str();
 }
+#endif
+
+//------------------------------------------------------------------------------------------------//
+namespace {
+
+bool is_binop(const node* cur, binop op) {
+  return
+    cur && cur->type == node_type::binop_expr && static_cast<const binop_expr*>(cur)->op == op;
+}
+
+// Build a balanced tree of `operands`, where `operators[i]` is the node of the operator between
+// `operands[i]` and `operands[i + 1]`. The recursion is only as deep as the balanced tree.
+node* build_balanced(std::span<node*> operands, std::span<binop_expr*> operators) {
+  if (operands.size() == 1) {
+    return operands[0];
+  }
+  const size_t mid = operands.size() / 2;
+  binop_expr* root = operators[mid - 1];
+  root->lhs = build_balanced(operands.first(mid), operators.first(mid - 1));
+  root->rhs = build_balanced(operands.subspan(mid), operators.subspan(mid));
+  return root;
+}
+
+} // End unnamed namespace.
+
+// The tree is walked in postorder with a stack, since chains may be far deeper than the native
+// stack. A chain is rebalanced at its root once its operands have been, and whether a subtree
+// contains a float literal is passed up from its children.
+void rebalance(tree& abs_syntax, reassociation mode) {
+  struct frame {
+    node** slot; // The parent's pointer to the node, which is replaced if the node is rebalanced.
+    bool is_chain_root;
+    bool children_pushed;
+  };
+  std::vector<frame> pending = {{&abs_syntax.root, true, false}};
+  std::vector<bool> has_float; // For each finished subtree whose parent is not yet finished.
+  std::vector<binop_expr*> chain_nodes;
+  std::vector<node*> operands;
+  std::vector<binop_expr*> operators;
+  while (!pending.empty()) {
+    const frame top = pending.back();
+    node* cur = *top.slot;
+    if (!cur) {
+      pending.pop_back();
+      has_float.push_back(false);
+      continue;
+    }
+    if (!top.children_pushed) {
+      pending.back().children_pushed = true;
+      if (cur->type == node_type::binop_expr) {
+        auto& binop_node = static_cast<binop_expr&>(*cur);
+        const bool is_chain_op = binop_node.op == binop::add || binop_node.op == binop::mul;
+        (pending.push_back
+          ({&binop_node.rhs, !is_chain_op || !is_binop(binop_node.rhs, binop_node.op), false}));
+        (pending.push_back
+          ({&binop_node.lhs, !is_chain_op || !is_binop(binop_node.lhs, binop_node.op), false}));
+      } else if (cur->type == node_type::unop_expr) {
+        pending.push_back({&static_cast<unop_expr&>(*cur).operand, true, false});
+      }
+      continue;
+    }
+    pending.pop_back();
+
+    bool is_float = cur->type == node_type::float_lit;
+    if (cur->type == node_type::binop_expr) {
+      is_float = has_float.back() || has_float[has_float.size() - 2];
+      has_float.resize(has_float.size() - 2);
+    } else if (cur->type == node_type::unop_expr) {
+      is_float = has_float.back();
+      has_float.pop_back();
+    }
+    has_float.push_back(is_float);
+
+    const auto* binop_node = static_cast<const binop_expr*>(cur);
+    if (!top.is_chain_root
+        || cur->type != node_type::binop_expr
+        || (binop_node->op != binop::add && binop_node->op != binop::mul)
+        || (is_float && mode != reassociation::integers_and_floats)) {
+      continue;
+    }
+    // List the operands and operators of the chain in source order.
+    const binop op = binop_node->op;
+    operands.clear();
+    operators.clear();
+    for (node* next = cur; ; ) {
+      while (is_binop(next, op)) {
+        chain_nodes.push_back(static_cast<binop_expr*>(next));
+        next = chain_nodes.back()->lhs;
+      }
+      operands.push_back(next);
+      if (chain_nodes.empty()) {
+        break;
+      }
+      operators.push_back(chain_nodes.back());
+      chain_nodes.pop_back();
+      next = operators.back()->rhs;
+    }
+    if (operands.size() > 2) {
+      *top.slot = build_balanced(operands, operators);
+    }
+  }
+}
 
 bool operator==(const node& lhs, const node& rhs) {
   if (lhs.type != rhs.type || lhs.main_token != rhs.main_token) {
@@ -29,8 +193,6 @@ bool operator==(const node& lhs, const node& rhs) {
     case node_type::unop_expr:
       return static_cast<const unop_expr&>(lhs) == static_cast<const unop_expr&>(rhs);
     case node_type::ident:
-      // TODO
-      return false;
     case node_type::int_lit:
     case node_type::float_lit:
       return true;
@@ -51,3 +213,237 @@ bool operator==(const unop_expr& lhs, const unop_expr& rhs) {
 
 
 }; // End `ast` namespace.
+
+
+//------------------------------------------------------------------------------------------------//
+#if !defined(DOCTEST_CONFIG_DISABLE)
+TEST_SUITE_BEGIN("parsing");
+
+TEST_CASE("node arena") {
+  using namespace ast;
+  arena nodes;
+  CHECK(nodes.capacity() == 0);
+  // A chain of mixed nodes that spans many blocks.
+  std::vector<node*> made;
+  node* prev = nodes.make<int_lit>(0);
+  made.push_back(prev);
+  for (token_index i = 1; i < 100000; i++) {
+    if (i % 3 == 0) {
+      prev = nodes.make<unop_expr>(unop::neg, i, prev);
+    } else if (i % 3 == 1) {
+      prev = nodes.make<binop_expr>(binop::add, i, prev, nodes.make<float_lit>(i));
+    } else {
+      prev = nodes.make<node>(node_type::ident, i);
+    }
+    made.push_back(prev);
+  }
+  for (token_index i = 0; i < made.size(); i++) {
+    CAPTURE(i);
+    REQUIRE(reinterpret_cast<uintptr_t>(made[i]) % alignof(binop_expr) == 0);
+    REQUIRE(made[i]->main_token == i);
+  }
+  auto& last_binop = static_cast<binop_expr&>(*made[99997]);
+  CHECK(last_binop.lhs == made[99996]);
+  CHECK(last_binop.rhs->type == node_type::float_lit);
+  CHECK(last_binop.rhs->main_token == 99997);
+  // Blocks grow, so unused space is a fraction of the arena.
+  const size_t used = 33333 * (sizeof(unop_expr) + sizeof(binop_expr) + sizeof(node) + 8) + 8;
+  CHECK(nodes.capacity() >= used);
+  CHECK(nodes.capacity() < used + (size_t(1) << 20) + (size_t(4) << 10));
+
+  // Nodes stay where they are when the arena is moved.
+  arena moved(std::move(nodes));
+  CHECK(made[50000]->main_token == 50000);
+  CHECK(moved.capacity() > 0);
+  CHECK(nodes.capacity() == 0);
+  CHECK(nodes.make<int_lit>(7)->main_token == 7);
+}
+
+TEST_CASE("pretty printing deep trees") {
+  using namespace ast;
+  std::string text;
+  for (int i = 0; i < 1000000; i++) {
+    text += "- ";
+  }
+  text += "1";
+  parsing::parser_test_source source(text.c_str());
+  parsing::parser(source).parse();
+  REQUIRE(source.abs_syntax->root);
+
+  // Only the nodes down to the maximum depth are printed, followed by a count of the rest.
+  std::string out;
+  pretty_printer pp(*source.abs_syntax, std::back_inserter(out));
+  pp.traverse_ast();
+  const size_t max_depth = pp.max_depth;
+  CHECK(std::count(out.begin(), out.end(), '\n') == max_depth + 2);
+  CHECK(out.starts_with("UnaryOperator `-`\n"));
+  CHECK(out.ends_with(fmt::format("... {} nodes deeper than {} levels not shown\n",
+                                  1000001 - (max_depth + 1), max_depth)));
+  CHECK(out.size() < 4 * max_depth * max_depth);
+
+  // A shallower tree is printed whole, and a lower maximum leaves out more of it.
+  parsing::parser_test_source small("-(1 + 2)");
+  parsing::parser(small).parse();
+  std::string whole;
+  pretty_printer whole_pp(*small.abs_syntax, std::back_inserter(whole));
+  whole_pp.traverse_ast();
+  CHECK(whole.find("not shown") == std::string::npos);
+  CHECK(std::count(whole.begin(), whole.end(), '\n') == 4);
+  std::string cut;
+  pretty_printer cut_pp(*small.abs_syntax, std::back_inserter(cut));
+  cut_pp.max_depth = 0;
+  cut_pp.traverse_ast();
+  CHECK(cut == "UnaryOperator `-`\n└── ... 3 nodes deeper than 0 levels not shown\n");
+}
+
+TEST_CASE("shared token arrays") {
+  using enum token::type;
+  parsing::parser_test_source source("a + b * (c - 1)");
+  parsing::parser(source).parse();
+  {
+    const ast::tree& parsed = *source.abs_syntax;
+
+    // Trees and slices built from the tokens of another tree read the same elements.
+    const ast::tree copy(nullptr, {}, parsed.text, parsed.tokens, parsed.token_locs);
+    CHECK(copy.tokens.data() == parsed.tokens.data());
+    CHECK(copy.token_locs.shares_storage(parsed.token_locs));
+    const shared_array<token::type> group = parsed.tokens.slice(4, 5);
+    CHECK(group.data() == parsed.tokens.data() + 4);
+    CHECK(group == std::vector{left_paren, ident, dash, int_literal, right_paren});
+    CHECK(group.slice(1, 3).front() == ident);
+    CHECK(group.slice(1, 3).back() == int_literal);
+    CHECK(parsed.tokens.slice(2, 0).empty());
+
+    // A slice outlives the array that it was taken from.
+    shared_array<token::type> kept;
+    {
+      shared_array<token::type> tokens(std::vector{ident, plus, ident, eof});
+      kept = tokens.slice(1, 2);
+    }
+    CHECK(kept == std::vector{plus, ident});
+
+    // Releasing the only view of a whole array takes its elements, and releasing any other view
+    // copies them.
+    std::vector<module::span> locs = {{0, 1}, {2, 1}, {4, 1}};
+    const module::span* elems = locs.data();
+    shared_array<module::span> only(std::move(locs));
+    CHECK(only.data() == elems);
+    CHECK(std::move(only).release().data() == elems);
+    CHECK(only.empty());
+    shared_array<module::span> shared = parsed.token_locs;
+    const std::vector<module::span> copied = std::move(shared).release();
+    CHECK(copied.data() != parsed.token_locs.data());
+    CHECK(copied.size() == parsed.token_locs.size());
+    const std::vector<module::span> part = parsed.token_locs.slice(1, 2).release();
+    CHECK(part == std::vector(parsed.token_locs.begin() + 1, parsed.token_locs.begin() + 3));
+  }
+
+  // Reparsing takes the tokens of the tree that it replaces, unless they are shared.
+  const token::type* old_tokens = source.abs_syntax->tokens.data();
+  parsing::parser(source).reparse({0, 1, "z"});
+  CHECK(source.abs_syntax->tokens.data() == old_tokens);
+  const shared_array<token::type> held = source.abs_syntax->tokens;
+  parsing::parser(source).reparse({0, 1, "y"});
+  CHECK(source.abs_syntax->tokens.data() != held.data());
+  CHECK(held[0] == ident);
+  CHECK(source.abs_syntax->tokens == held);
+}
+
+namespace {
+
+// The lexemes of a tree as an s-expression, by recursion, so only for shallow trees.
+std::string sexpr(const ast::tree& abs_syntax, const ast::node* cur) {
+  if (!cur) {
+    return "_";
+  }
+  const std::string_view lexeme =
+    abs_syntax.token_locs[cur->main_token].contents(abs_syntax.text);
+  if (cur->type == ast::node_type::binop_expr) {
+    const auto& binop = static_cast<const ast::binop_expr&>(*cur);
+    return
+      fmt::format
+        ("({} {} {})", lexeme, sexpr(abs_syntax, binop.lhs), sexpr(abs_syntax, binop.rhs));
+  }
+  if (cur->type == ast::node_type::unop_expr) {
+    const auto& unop = static_cast<const ast::unop_expr&>(*cur);
+    return fmt::format("({} {})", lexeme, sexpr(abs_syntax, unop.operand));
+  }
+  return std::string(lexeme);
+}
+
+// The height of a tree, counting nodes, from its flat form.
+size_t height(const ast::flat_tree& nodes) {
+  std::vector<size_t> heights(nodes.size());
+  for (size_t i = 0; i < nodes.size(); i++) {
+    heights[i] = 1;
+    for (ast::node_index child : nodes.children[i]) {
+      if (child != ast::no_node) {
+        heights[i] = std::max(heights[i], heights[child] + 1);
+      }
+    }
+  }
+  return heights.empty() ? 0 : heights.back();
+}
+
+} // End unnamed namespace.
+
+TEST_CASE("rebalancing") {
+  using namespace ast;
+  auto rebalanced = [](const char* text, reassociation mode = reassociation::integers) {
+    parsing::parser_test_source source(text);
+    parsing::parser(source).parse();
+    rebalance(*source.abs_syntax, mode);
+    return sexpr(*source.abs_syntax, source.abs_syntax->root);
+  };
+  // Every operator stays between the operands on either side of its token.
+  CHECK(rebalanced("a + b + c + d") == "(+ (+ a b) (+ c d))");
+  CHECK(rebalanced("a + b + c") == "(+ a (+ b c))");
+  CHECK(rebalanced("a + (b + (c + (d + e)))") == "(+ (+ a b) (+ c (+ d e)))");
+  CHECK(rebalanced("a + b") == "(+ a b)");
+  CHECK(rebalanced("1 * 2 * 3 * 4 + 5 + 6") == "(+ (* (* 1 2) (* 3 4)) (+ 5 6))");
+  // Other operators end a chain, and chains inside a chain's operands are balanced too.
+  CHECK(rebalanced("a - b - c - d") == "(- (- (- a b) c) d)");
+  CHECK(rebalanced("a + b - c + d + e") == "(+ (- (+ a b) c) (+ d e))");
+  CHECK(rebalanced("-(a * b * c * d) + e") == "(+ (- (* (* a b) (* c d))) e)");
+  // Float chains only move when they may round differently.
+  CHECK(rebalanced("a + b + 1.5 + c") == "(+ (+ (+ a b) 1.5) c)");
+  CHECK(rebalanced("a + b + -1.5 + c") == "(+ (+ (+ a b) (- 1.5)) c)");
+  (CHECK
+    (rebalanced("a + b + 1.5 + c", reassociation::integers_and_floats)
+       == "(+ (+ a b) (+ 1.5 c))"));
+  CHECK(rebalanced("(a + b + c + d) * 1.5") == "(* (+ (+ a b) (+ c d)) 1.5)");
+  // A missing operand stays missing.
+  CHECK(rebalanced("a + b + c +") == "(+ (+ a b) (+ c _))");
+  CHECK(rebalanced("") == "_");
+
+  // A long chain ends up logarithmically deep, with its tokens still in order.
+  std::string text = "x0";
+  for (int i = 1; i < 100000; i++) {
+    text += fmt::format(" {} x{}", i % 1000 == 0 ? '*' : '+', i);
+  }
+  parsing::parser_test_source source(text.c_str());
+  parsing::parser(source).parse();
+  tree& parsed = *source.abs_syntax;
+  CHECK(height(flatten(parsed.root)) > 99000);
+  rebalance(parsed, reassociation::integers);
+  const flat_tree nodes = flatten(parsed.root);
+  CHECK(nodes.size() == 199999);
+  CHECK(height(nodes) <= 19);
+  std::vector<token_index> in_order;
+  std::vector<node_index> pending;
+  for (node_index next = nodes.root(); next != no_node || !pending.empty(); ) {
+    if (next != no_node) {
+      pending.push_back(next);
+      next = nodes.children[next][0];
+    } else {
+      in_order.push_back(nodes.main_tokens[pending.back()]);
+      next = nodes.children[pending.back()][1];
+      pending.pop_back();
+    }
+  }
+  CHECK(in_order.size() == nodes.size());
+  CHECK(std::is_sorted(in_order.begin(), in_order.end()));
+}
+
+TEST_SUITE_END();
+#endif
@@ -1,9 +1,16 @@
 #ifndef AST_H
 #define AST_H
+#include "interner.hpp"
+#include "shared_array.hpp"
 #include "token.hpp"
 #include "doctest.hpp"
 
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
 #include <vector>
+#include <cstddef>
 #include <cstdint>
 #include <iostream>
 #include <iterator>
@@ -14,22 +21,120 @@ namespace ast {
 typedef uint32_t token_index;
 struct node;
 
+// The value of every integer and float literal token of a source, which the lexer decodes as it
+// scans the literal. Only literals have an entry, so entries are kept in token order and found by
+// their token index with a binary search. A float is stored as the bits of a double.
+struct literal_table {
+  std::vector<token_index> tokens;
+  std::vector<uint64_t> values;
+
+  void push_back(token_index idx, uint64_t value);
+  uint64_t int_value(token_index idx) const;
+  double float_value(token_index idx) const;
+};
+
+// The storage of the nodes of a tree. Nodes are placed one after another, in the order that they
+// are made, in blocks that are only freed with the arena. Making a node is then a pointer bump, the
+// nodes of a subtree are close together in memory, and a tree of any depth is freed without
+// visiting its nodes. Nodes must therefore be trivially destructible, and they refer to their
+// children by plain pointers.
+class arena {
+public:
+  arena() = default;
+  arena(arena&& other) noexcept;
+  arena& operator=(arena&& other) noexcept;
+
+  template <typename N, typename... Args> N* make(Args&&... args) {
+    static_assert(std::is_trivially_destructible_v<N>);
+    return new (allocate(sizeof(N), alignof(N))) N(std::forward<Args>(args)...);
+  }
+
+  // The number of bytes held by the arena, including the unused space at the end of each block.
+  size_t capacity() const;
+
+  // Take the blocks of `other`, so that its nodes live as long as this arena, and leave it empty.
+  void splice(arena&& other);
+
+private:
+  // Blocks double in size from the first to the last, so that a small tree stays small and a large
+  // one needs few blocks.
+  static constexpr size_t first_block_size = size_t(4) << 10;
+  static constexpr size_t max_block_size = size_t(1) << 20;
+
+  std::vector<std::unique_ptr<std::byte[]>> blocks;
+  std::byte* next = nullptr; // The free part of the last block.
+  std::byte* end = nullptr;
+  size_t num_bytes = 0;
+
+  void* allocate(size_t size, size_t align) {
+    std::byte* slot =
+      reinterpret_cast<std::byte*>((reinterpret_cast<uintptr_t>(next) + align - 1) & ~(align - 1));
+    if (!next || size > size_t(end - slot)) {
+      add_block(size + align);
+      return allocate(size, align);
+    }
+    next = slot + size;
+    return slot;
+  }
+
+  void add_block(size_t min_size);
+};
+
 struct tree {
-  std::unique_ptr<node> root;
-  const std::vector<token::type> tokens;
-  const std::vector<module::span> token_locs;
+  node* root = nullptr;
+  arena nodes; // Holds `root` and its descendants.
+  const char* text; // The start of the source that `token_locs` are offsets into.
+  // The tokens are shared with anything else that holds them, such as a slice kept by a tool or the
+  // next tree of an edited source, so passing them on never copies them.
+  shared_array<token::type> tokens;
+  shared_array<module::span> token_locs;
+  // The symbol of each identifier token, and `interner::no_symbol` for every other token. Names
+  // are compared by comparing their symbols.
+  shared_array<symbol> token_symbols;
+  const literal_table literals;
+  std::shared_ptr<const interner> symbols;
 
   tree() = default;
 
-  tree(std::unique_ptr<node> root,
-       const std::vector<token::type> tokens,
-       const std::vector<module::span> token_locs)
-    : root(std::move(root)), tokens(tokens), token_locs(token_locs) {}
+  tree(node* root,
+       arena nodes,
+       const char* text,
+       shared_array<token::type> tokens,
+       shared_array<module::span> token_locs,
+       shared_array<symbol> token_symbols = {},
+       literal_table literals = {},
+       std::shared_ptr<const interner> symbols = nullptr)
+    : root(root),
+      nodes(std::move(nodes)),
+      text(text),
+      tokens(std::move(tokens)),
+      token_locs(std::move(token_locs)),
+      token_symbols(std::move(token_symbols)),
+      literals(std::move(literals)),
+      symbols(std::move(symbols)) {}
 };
 
 bool operator==(const tree& lhs, const tree& rhs);
 
+// Which chains `rebalance` may regroup. Regrouping integer sums and products, which wrap on
+// overflow, never changes their value, but regrouping float ones can change how they round. There
+// are no declared types yet, so a chain counts as a float chain if any of its operands contains a
+// float literal.
+enum class reassociation : uint8_t {
+  integers,
+  integers_and_floats,
+};
+
+// Turn every chain of `+` or of `*`, such as the left-deep `((a + b) + c) + d` that the parser
+// makes for `a + b + c + d`, into a balanced tree of the same operands in the same order, so that
+// its depth is logarithmic in its length. The operator nodes of a chain are reused, and each node
+// becomes the root of the operands on either side of its own token, so nodes keep their tokens and
+// the tokens of a tree in order are still in source order. Other operators end a chain.
+void rebalance(tree& abs_syntax, reassociation mode);
+
+#if !defined(DOCTEST_CONFIG_DISABLE)
 doctest::String toString(const tree& tree);
+#endif
 
 
 enum class node_type : uint8_t {
@@ -59,16 +164,16 @@ enum class binop : uint8_t {
 
 struct binop_expr : node {
   binop op;
-  std::unique_ptr<node> lhs;
-  std::unique_ptr<node> rhs;
+  node* lhs;
+  node* rhs;
 
   binop_expr(
     binop op,
     token_index main_token,
-    std::unique_ptr<node> lhs = nullptr,
-    std::unique_ptr<node> rhs = nullptr
+    node* lhs = nullptr,
+    node* rhs = nullptr
   ) : node(node_type::binop_expr, main_token),
-      op(op), lhs(std::move(lhs)), rhs(std::move(rhs)) {}
+      op(op), lhs(lhs), rhs(rhs) {}
 };
 
 bool operator==(const binop_expr& lhs, const binop_expr& rhs);
@@ -81,11 +186,11 @@ enum class unop : uint8_t {
 
 struct unop_expr : node {
   unop op;
-  std::unique_ptr<node> operand;
+  node* operand;
 
-  unop_expr(unop op, token_index main_token, std::unique_ptr<node> operand = nullptr)
+  unop_expr(unop op, token_index main_token, node* operand = nullptr)
     : node(node_type::unop_expr, main_token),
-      op(op), operand(std::move(operand)) {}
+      op(op), operand(operand) {}
 };
 
 bool operator==(const unop_expr& lhs, const unop_expr& rhs);
@@ -0,0 +1,552 @@
+#include "ast_cache.hpp"
+#include "flat_ast.hpp"
+#include "parser.hpp"
+#include "doctest.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <unordered_map>
+#include <fmt/core.h>
+
+namespace ast_cache {
+
+//------------------------------------------------------------------------------------------------//
+namespace {
+
+constexpr uint64_t prime1 = 0x9E3779B185EBCA87;
+constexpr uint64_t prime2 = 0xC2B2AE3D27D4EB4F;
+constexpr uint64_t prime3 = 0x165667B19E3779F9;
+constexpr uint64_t prime4 = 0x85EBCA77C2B2AE63;
+constexpr uint64_t prime5 = 0x27D4EB2F165667C5;
+
+uint64_t load64(const char* p) {
+  uint64_t word;
+  std::memcpy(&word, p, 8);
+  return word;
+}
+
+uint64_t lane_round(uint64_t acc, uint64_t input) {
+  return std::rotl(acc + input * prime2, 31) * prime1;
+}
+
+uint64_t merge_round(uint64_t acc, uint64_t lane) {
+  return (acc ^ lane_round(0, lane)) * prime1 + prime4;
+}
+
+constexpr std::array<char, 4> magic = {'K', 'A', 'S', 'T'};
+constexpr std::string_view entry_extension = ".kast";
+constexpr std::string_view stats_name = "stats";
+
+struct entry_header {
+  std::array<char, 4> magic;
+  uint32_t num_tokens;
+  uint32_t num_literals;
+  uint32_t num_names;
+  uint32_t names_size;
+  uint32_t num_nodes;
+};
+
+// Files are written under a name of their own and then renamed, so that a reader never sees part
+// of one.
+std::string temp_suffix() {
+  return fmt::format(".tmp{:08x}", std::random_device()());
+}
+
+template <typename V> void append(std::string& out, const V* data, size_t count) {
+  out.append(reinterpret_cast<const char*>(data), count * sizeof(V));
+}
+
+// Reads the arrays of an entry in order. A read past the end of an entry, which can only happen if
+// the entry is corrupt, fails rather than reading past the buffer.
+class entry_reader {
+public:
+  entry_reader(std::string_view contents) : contents(contents) {}
+
+  template <typename V> bool read(V* dest, size_t count) {
+    if (!holds<V>(count)) {
+      return false;
+    }
+    std::memcpy(dest, contents.data() + pos, count * sizeof(V));
+    pos += count * sizeof(V);
+    return true;
+  }
+
+  template <typename V> bool read(std::vector<V>& dest, size_t count) {
+    return read_array(dest, count);
+  }
+
+  bool read(std::string& dest, size_t count) { return read_array(dest, count); }
+
+private:
+  std::string_view contents;
+  size_t pos = 0;
+
+  // Whether the rest of the entry has room for `count` values. The count is divided rather than
+  // multiplied so that a corrupt count cannot overflow.
+  template <typename V> bool holds(size_t count) const {
+    return count <= (contents.size() - pos) / sizeof(V);
+  }
+
+  // The array is only sized once the entry is known to hold it, so a corrupt count in the header
+  // is a failed read rather than an allocation of gigabytes.
+  template <typename A> bool read_array(A& dest, size_t count) {
+    if (!holds<typename A::value_type>(count)) {
+      return false;
+    }
+    dest.resize(count);
+    return read(dest.data(), count);
+  }
+};
+
+std::string serialize(const ast::tree& tree) {
+  // Symbols are numbered by the order that their names first appear in this tree, since the
+  // interner that loads the entry may have numbered them differently.
+  std::vector<symbol> local_symbols(tree.token_symbols.size(), interner::no_symbol);
+  std::unordered_map<symbol, symbol> local_ids;
+  std::vector<uint32_t> name_sizes;
+  std::string names;
+  for (size_t i = 0; i < tree.token_symbols.size(); i++) {
+    const symbol id = tree.token_symbols[i];
+    if (id == interner::no_symbol) {
+      continue;
+    }
+    auto [iter, inserted] = local_ids.try_emplace(id, symbol(name_sizes.size()));
+    if (inserted) {
+      const std::string_view name = tree.symbols->name(id);
+      name_sizes.push_back(name.size());
+      names += name;
+    }
+    local_symbols[i] = iter->second;
+  }
+
+  const ast::flat_tree nodes = ast::flatten(tree.root);
+  const entry_header header = {
+    magic,
+    uint32_t(tree.tokens.size()),
+    uint32_t(tree.literals.tokens.size()),
+    uint32_t(name_sizes.size()),
+    uint32_t(names.size()),
+    uint32_t(nodes.size()),
+  };
+  std::string out;
+  append(out, &header, 1);
+  append(out, tree.tokens.data(), tree.tokens.size());
+  append(out, tree.token_locs.data(), tree.token_locs.size());
+  append(out, local_symbols.data(), local_symbols.size());
+  append(out, tree.literals.tokens.data(), tree.literals.tokens.size());
+  append(out, tree.literals.values.data(), tree.literals.values.size());
+  append(out, name_sizes.data(), name_sizes.size());
+  out += names;
+  append(out, nodes.types.data(), nodes.size());
+  append(out, nodes.ops.data(), nodes.size());
+  append(out, nodes.main_tokens.data(), nodes.size());
+  append(out, nodes.children.data(), nodes.size());
+  return out;
+}
+
+// Check the arrays of an entry against each other and against the source they were read for. Every
+// token kind is known and every token lies within the source, where the eof token may cover the
+// first of its two terminating null bytes. Literals are listed once each, in token order, and only
+// for literal tokens, and every literal node has a value of the right kind.
+bool tokens_are_valid
+  (const std::vector<token::type>& tokens,
+   const std::vector<module::span>& token_locs,
+   const ast::literal_table& literals,
+   const ast::flat_tree& nodes,
+   size_t source_size) {
+  for (size_t i = 0; i < tokens.size(); i++) {
+    const module::span loc = token_locs[i];
+    if (tokens[i] >= token::type::num_tokens || loc.lo > source_size ||
+        loc.len > source_size + 1 - loc.lo) {
+      return false;
+    }
+  }
+  for (size_t i = 0; i < literals.tokens.size(); i++) {
+    const ast::token_index idx = literals.tokens[i];
+    if ((i > 0 && idx <= literals.tokens[i - 1]) || idx >= tokens.size() ||
+        (tokens[idx] != token::type::int_literal && tokens[idx] != token::type::float_literal)) {
+      return false;
+    }
+  }
+  for (size_t i = 0; i < nodes.size(); i++) {
+    const ast::token_index idx = nodes.main_tokens[i];
+    const bool is_int = nodes.types[i] == ast::node_type::int_lit;
+    if (!is_int && nodes.types[i] != ast::node_type::float_lit) {
+      continue;
+    }
+    if (tokens[idx] != (is_int ? token::type::int_literal : token::type::float_literal) ||
+        !std::binary_search(literals.tokens.begin(), literals.tokens.end(), idx)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // End unnamed namespace.
+
+
+uint64_t content_hash(const char* data, size_t size, uint64_t seed) {
+  const char* p = data;
+  const char* const end = data + size;
+  uint64_t hash;
+  if (size >= 32) {
+    uint64_t lanes[4] = {seed + prime1 + prime2, seed + prime2, seed, seed - prime1};
+    for (; end - p >= 32; p += 32) {
+      for (int i = 0; i < 4; i++) {
+        lanes[i] = lane_round(lanes[i], load64(p + 8 * i));
+      }
+    }
+    hash =
+      std::rotl(lanes[0], 1) + std::rotl(lanes[1], 7) + std::rotl(lanes[2], 12) +
+      std::rotl(lanes[3], 18);
+    for (uint64_t lane : lanes) {
+      hash = merge_round(hash, lane);
+    }
+  } else {
+    hash = seed + prime5;
+  }
+  hash += size;
+
+  for (; end - p >= 8; p += 8) {
+    hash = std::rotl(hash ^ lane_round(0, load64(p)), 27) * prime1 + prime4;
+  }
+  if (end - p >= 4) {
+    uint32_t word;
+    std::memcpy(&word, p, 4);
+    hash = std::rotl(hash ^ (word * prime1), 23) * prime2 + prime3;
+    p += 4;
+  }
+  for (; p < end; p++) {
+    hash = std::rotl(hash ^ (uint8_t(*p) * prime5), 11) * prime1;
+  }
+
+  hash ^= hash >> 33;
+  hash *= prime2;
+  hash ^= hash >> 29;
+  hash *= prime3;
+  return hash ^ hash >> 32;
+}
+
+cache::cache(fs::path dir, uint64_t max_bytes) : dir(std::move(dir)), max_bytes(max_bytes) {
+  std::error_code ec;
+  fs::create_directories(this->dir, ec);
+  std::ifstream(this->dir / stats_name, std::ios::binary)
+    .read(reinterpret_cast<char*>(&saved_stats), sizeof(saved_stats));
+}
+
+// Runs that share a directory at the same time may lose each other's counts, so the totals are
+// only a guide.
+cache::~cache() {
+  const stats total = totals();
+  const fs::path tmp_path = dir / fmt::format("{}{}", stats_name, temp_suffix());
+  std::ofstream(tmp_path, std::ios::binary)
+    .write(reinterpret_cast<const char*>(&total), sizeof(total));
+  std::error_code ec;
+  fs::rename(tmp_path, dir / stats_name, ec);
+}
+
+bool cache::load(module::file& file, std::shared_ptr<interner> symbols) {
+  const fs::path path = entry_path(file);
+  // The entry is read whole, with one allocation of its size.
+  std::ifstream in_stream(path, std::ios::binary | std::ios::ate);
+  const std::streamoff size = in_stream ? std::streamoff(in_stream.tellg()) : -1;
+  std::string contents(std::max(size, std::streamoff(0)), '\0');
+  if (size < 0 || !in_stream.seekg(0) || !in_stream.read(contents.data(), size)) {
+    run_stats.misses += 1;
+    return false;
+  }
+  entry_reader in(contents);
+  entry_header header;
+  std::vector<token::type> tokens;
+  std::vector<module::span> token_locs;
+  std::vector<symbol> token_symbols;
+  ast::literal_table literals;
+  std::vector<uint32_t> name_sizes;
+  std::string names;
+  ast::flat_tree nodes;
+  bool ok =
+    in.read(&header, 1) && header.magic == magic &&
+    in.read(tokens, header.num_tokens) &&
+    in.read(token_locs, header.num_tokens) &&
+    in.read(token_symbols, header.num_tokens) &&
+    in.read(literals.tokens, header.num_literals) &&
+    in.read(literals.values, header.num_literals) &&
+    in.read(name_sizes, header.num_names);
+  if (ok) {
+    ok =
+      in.read(names, header.names_size) &&
+      in.read(nodes.types, header.num_nodes) &&
+      in.read(nodes.ops, header.num_nodes) &&
+      in.read(nodes.main_tokens, header.num_nodes) &&
+      in.read(nodes.children, header.num_nodes) &&
+      nodes.is_well_formed(tokens.size()) &&
+      tokens_are_valid(tokens, token_locs, literals, nodes, file.size());
+  }
+  ast::arena tree_nodes;
+  ast::node* root = nullptr;
+  if (ok) {
+    root = ast::unflatten(nodes, tree_nodes);
+  }
+
+  // Local symbols become symbols of `symbols`.
+  if (!symbols) {
+    symbols = std::make_shared<interner>();
+  }
+  std::vector<symbol> global_ids;
+  for (size_t i = 0, offset = 0; ok && i < name_sizes.size(); offset += name_sizes[i++]) {
+    ok = name_sizes[i] <= names.size() - offset;
+    if (ok) {
+      global_ids.push_back(symbols->intern(std::string_view(names).substr(offset, name_sizes[i])));
+    }
+  }
+  for (size_t i = 0; ok && i < token_symbols.size(); i++) {
+    if (token_symbols[i] != interner::no_symbol) {
+      ok = token_symbols[i] < global_ids.size();
+      token_symbols[i] = ok ? global_ids[token_symbols[i]] : interner::no_symbol;
+    }
+  }
+  if (!ok) {
+    // A corrupt entry is replaced when the source is stored again.
+    run_stats.misses += 1;
+    return false;
+  }
+
+  (file.abs_syntax = std::make_unique<ast::tree>
+    (root, std::move(tree_nodes), file.start(), std::move(tokens), std::move(token_locs),
+     std::move(token_symbols), std::move(literals), std::move(symbols)));
+  // A hit counts as a use for eviction.
+  std::error_code ec;
+  fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+  run_stats.hits += 1;
+  return true;
+}
+
+void cache::store(const module::file& file) {
+  const std::string entry = serialize(*file.abs_syntax);
+  const fs::path path = entry_path(file);
+  fs::path tmp_path = path;
+  tmp_path += temp_suffix();
+  {
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    out.write(entry.data(), entry.size());
+    if (!out) {
+      return;
+    }
+  }
+  std::error_code ec;
+  fs::rename(tmp_path, path, ec);
+  if (ec) {
+    fs::remove(tmp_path, ec);
+    return;
+  }
+  run_stats.stores += 1;
+  evict();
+}
+
+stats cache::totals() const {
+  return {
+    saved_stats.hits + run_stats.hits,
+    saved_stats.misses + run_stats.misses,
+    saved_stats.stores + run_stats.stores,
+    saved_stats.evictions + run_stats.evictions,
+  };
+}
+
+fs::path cache::entry_path(const module::file& file) const {
+  const uint64_t version_hash = content_hash(compiler_version.data(), compiler_version.size());
+  const uint64_t hash = content_hash(file.start(), file.size(), version_hash);
+  return dir / fmt::format("{:016x}-{:x}{}", hash, file.size(), entry_extension);
+}
+
+// Remove the least recently used entries until the rest fit in `max_bytes`.
+void cache::evict() {
+  struct entry {
+    fs::path path;
+    fs::file_time_type last_use;
+    uint64_t size;
+  };
+  std::vector<entry> entries;
+  uint64_t total_size = 0;
+  std::error_code ec;
+  for (const fs::directory_entry& dir_entry : fs::directory_iterator(dir, ec)) {
+    if (dir_entry.path().extension() != entry_extension) {
+      continue;
+    }
+    const uint64_t size = dir_entry.file_size(ec);
+    entries.push_back({dir_entry.path(), dir_entry.last_write_time(ec), size});
+    total_size += size;
+  }
+  if (total_size <= max_bytes) {
+    return;
+  }
+  (std::sort
+    (entries.begin(), entries.end(),
+     [](const entry& a, const entry& b) { return a.last_use < b.last_use; }));
+  for (const entry& cur : entries) {
+    if (total_size <= max_bytes) {
+      break;
+    }
+    if (fs::remove(cur.path, ec)) {
+      total_size -= cur.size;
+      run_stats.evictions += 1;
+    }
+  }
+}
+
+} // End `ast_cache` namespace.
+
+
+//------------------------------------------------------------------------------------------------//
+#if !defined(DOCTEST_CONFIG_DISABLE)
+TEST_SUITE_BEGIN("caching");
+
+TEST_CASE("content hash") {
+  std::string text(1000, 'x');
+  std::vector<uint64_t> hashes;
+  for (size_t size = 0; size < 70; size++) {
+    hashes.push_back(ast_cache::content_hash(text.data(), size));
+  }
+  text[500] = 'y';
+  hashes.push_back(ast_cache::content_hash(text.data(), text.size()));
+  text[500] = 'x';
+  hashes.push_back(ast_cache::content_hash(text.data(), text.size()));
+  hashes.push_back(ast_cache::content_hash(text.data(), text.size(), 1));
+  std::sort(hashes.begin(), hashes.end());
+  CHECK(std::adjacent_find(hashes.begin(), hashes.end()) == hashes.end());
+  // Values from the reference implementation of xxHash64.
+  CHECK(ast_cache::content_hash("", 0) == 0xEF46DB3751D8E999);
+  CHECK(ast_cache::content_hash("a", 1) == 0xD24EC4F1A98C6E5B);
+  std::string digits;
+  for (int i = 0; i < 7; i++) {
+    digits += "0123456789";
+  }
+  CHECK(ast_cache::content_hash(digits.data(), digits.size()) == 0x4916A0F3F0E1C781);
+}
+
+TEST_CASE("ast cache") {
+  const fs::path dir = fs::temp_directory_path() / "kal-test-ast-cache";
+  const fs::path path = fs::temp_directory_path() / "kal-test-ast-cache.kal";
+  fs::remove_all(dir);
+  std::ofstream(path, std::ios::binary) << "-(alpha + 0x10) * beta / (2.5 - alpha)";
+
+  {
+    ast_cache::cache entries(dir);
+    module::file source(path);
+    CHECK(!entries.load(source));
+    parsing::parser(source).parse();
+    entries.store(source);
+
+    // A hit rebuilds the tree without lexing or parsing, and interns names into the given interner.
+    auto symbols = std::make_shared<interner>();
+    symbols->intern("gamma");
+    module::file cached(path);
+    REQUIRE(entries.load(cached, symbols));
+    const ast::tree& tree = *cached.abs_syntax;
+    CHECK(tree == *source.abs_syntax);
+    CHECK(tree.text == cached.start());
+    CHECK(tree.symbols == symbols);
+    CHECK(tree.token_symbols[2] == 1);
+    CHECK(symbols->name(tree.token_symbols[2]) == "alpha");
+    CHECK(tree.token_symbols[7] == 2);
+    CHECK(tree.token_symbols[12] == 1);
+    CHECK(tree.literals.tokens == source.abs_syntax->literals.tokens);
+    CHECK(tree.literals.int_value(4) == 16);
+    CHECK(tree.literals.float_value(10) == 2.5);
+  }
+  {
+    // Counts are kept across runs. Changed contents miss.
+    ast_cache::cache entries(dir);
+    CHECK(entries.totals().hits == 1);
+    CHECK(entries.totals().misses == 1);
+    CHECK(entries.totals().stores == 1);
+    std::ofstream(path, std::ios::binary) << "-(alpha + 0x10) * beta / (2.5 - alphb)";
+    module::file changed(path);
+    CHECK(!entries.load(changed));
+    CHECK(entries.totals().misses == 2);
+  }
+  {
+    // Entries whose tokens, literals, or nodes do not fit together or do not fit the source miss.
+    const std::string text = "-(alpha + 0x10) * beta / (2.5 - alpha)";
+    std::ofstream(path, std::ios::binary) << text;
+    ast_cache::cache entries(dir);
+    module::file source(path);
+    parsing::parser(source).parse();
+    entries.store(source);
+    fs::path entry_file;
+    for (const auto& entry : fs::directory_iterator(dir)) {
+      if (entry.path().extension() == ".kast") {
+        entry_file = entry.path();
+      }
+    }
+    std::ifstream entry_stream(entry_file, std::ios::binary);
+    const std::string entry(std::istreambuf_iterator<char>{entry_stream}, {});
+    entry_stream.close();
+    auto loads_with = [&](size_t offset, auto value) {
+      std::string changed = entry;
+      std::memcpy(changed.data() + offset, &value, sizeof(value));
+      std::ofstream(entry_file, std::ios::binary | std::ios::trunc) << changed;
+      module::file cached(path);
+      return entries.load(cached);
+    };
+
+    // 15 tokens, 2 literals, and the 2 names `alpha` and `beta` come before the nodes.
+    const ast::tree& tree = *source.abs_syntax;
+    REQUIRE(tree.tokens.size() == 15);
+    const size_t tokens_at = 24;
+    const size_t locs_at = tokens_at + 15;
+    const size_t literals_at = locs_at + 15 * 12;
+    const size_t num_nodes = ast::flatten(tree.root).size();
+    const size_t main_tokens_at = literals_at + 2 * 12 + 2 * 4 + 9 + 2 * num_nodes;
+    CHECK(loads_with(tokens_at, tree.tokens[0]));
+    CHECK(!loads_with(tokens_at, token::type::num_tokens));
+    CHECK(loads_with(locs_at + 14 * 8, module::span(text.size(), 1)));
+    CHECK(!loads_with(locs_at + 14 * 8, module::span(text.size(), 2)));
+    CHECK(!loads_with(locs_at + 3 * 8, module::span(uint32_t(-1), 2)));
+    CHECK(!loads_with(literals_at, ast::token_index(10)));
+    CHECK(!loads_with(literals_at + 4, ast::token_index(15)));
+    CHECK(!loads_with(literals_at + 4, ast::token_index(12)));
+    CHECK(!loads_with(tokens_at + 4, token::type::float_literal));
+    // Counts in the header that are larger than the entry fail without sizing arrays to them.
+    CHECK(!loads_with(4, uint32_t(-16)));
+    CHECK(!loads_with(16, uint32_t(-16)));
+    CHECK(!loads_with(20, uint32_t(-16)));
+    const std::string half = entry.substr(0, entry.size() / 2);
+    std::ofstream(entry_file, std::ios::binary | std::ios::trunc) << half;
+    module::file truncated(path);
+    CHECK(!entries.load(truncated));
+
+    // The first node is the first `alpha`.
+    CHECK(loads_with(main_tokens_at, ast::token_index(2)));
+    CHECK(!loads_with(main_tokens_at, ast::token_index(15)));
+  }
+  {
+    // The least recently used entries are evicted once the entries outgrow the cache.
+    ast_cache::cache entries(dir, 400);
+    for (int i = 0; i < 8; i++) {
+      std::ofstream(path, std::ios::binary) << fmt::format("a + b * {} - (c + d)", i);
+      module::file source(path);
+      parsing::parser(source).parse();
+      entries.store(source);
+    }
+    uint64_t total_size = 0;
+    for (const auto& entry : fs::directory_iterator(dir)) {
+      if (entry.path().extension() == ".kast") {
+        total_size += entry.file_size();
+      }
+    }
+    CHECK(total_size <= 400);
+    CHECK(entries.totals().evictions > 0);
+    module::file last(path);
+    CHECK(entries.load(last));
+  }
+  fs::remove_all(dir);
+  fs::remove(path);
+}
+
+TEST_SUITE_END();
+#endif
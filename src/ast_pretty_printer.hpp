@@ -8,8 +8,14 @@
 
 namespace ast {
 
+// Prints a tree with one line per node, indented by its depth. Each line repeats the branches of
+// every level above it, so the nodes deeper than `max_depth` are left out with a notice in their
+// place. The output then stays in proportion to the size of the tree, and printing recurses at most
+// `max_depth` levels, however deep the parser was able to nest its nodes.
 template <typename OutputIter=std::ostream_iterator<char>>
 struct pretty_printer : visitor<pretty_printer<OutputIter>> {
+  static constexpr size_t default_max_depth = 256;
+
   struct separator_chars {
     const char* branch = "│  ";
     const char* leaf = "├──";
@@ -20,6 +26,7 @@ struct pretty_printer : visitor<pretty_printer<OutputIter>> {
   const module::file *const source_file = nullptr;
   std::deque<const char*> branches;
   separator_chars separators;
+  size_t max_depth = default_max_depth;
 
   pretty_printer(const tree& abs_syntax) : visitor<pretty_printer>(abs_syntax) {}
 
@@ -37,6 +44,7 @@ struct pretty_printer : visitor<pretty_printer<OutputIter>> {
   void visit(float_lit& float_node);
   void visit(int_lit& int_node);
 
+  void visit_child(node& child);
   void print_branches() const;
   void print_loc(const module::span& loc) const;
 };
@@ -51,7 +59,7 @@ template <typename T> void pretty_printer<T>::visit(binop_expr& binop_node) {
   //   static_cast<T*>(this)->abs_syntax.token_locs[binop_node.main_token];
   const module::span& loc = this->abs_syntax.token_locs[binop_node.main_token];
   // print_indent();
-  fmt::format_to(out, "BinaryOperator `{:s}`", loc.contents());
+  fmt::format_to(out, "BinaryOperator `{:s}`", loc.contents(this->abs_syntax.text));
   print_loc(loc);
   // indent += indent_size;
   if (!branches.empty()) {
@@ -61,13 +69,13 @@ template <typename T> void pretty_printer<T>::visit(binop_expr& binop_node) {
     // fmt::print(stderr,"`pretty_printer<T>::visit(binop_expr&)`: calling visit on lhs\n");
     branches.push_back(separators.leaf);
     print_branches();
-    visitor<pretty_printer>::visit(*binop_node.lhs);
+    visit_child(*binop_node.lhs);
   }
   if (binop_node.rhs) {
     // fmt::print(stderr,"`pretty_printer<T>::visit(binop_expr&)`: calling visit on rhs\n");
     branches.back() = separators.last_leaf;
     print_branches();
-    visitor<pretty_printer>::visit(*binop_node.rhs);
+    visit_child(*binop_node.rhs);
   }
   // indent -= indent_size;
   // branches.front() = separators.leaf;
@@ -79,7 +87,7 @@ template <typename T> void pretty_printer<T>::visit(binop_expr& binop_node) {
 template <typename T> void pretty_printer<T>::visit(unop_expr& unop_node) {
   const module::span& loc = this->abs_syntax.token_locs[unop_node.main_token];
   // print_indent();
-  fmt::format_to(out, "UnaryOperator `{:s}`", loc.contents());
+  fmt::format_to(out, "UnaryOperator `{:s}`", loc.contents(this->abs_syntax.text));
   print_loc(loc);
   // indent += indent_size;
   if (!branches.empty()) {
@@ -88,7 +96,7 @@ template <typename T> void pretty_printer<T>::visit(unop_expr& unop_node) {
   if (unop_node.operand) {
     branches.push_back(separators.last_leaf);
     print_branches();
-    visitor<pretty_printer>::visit(*unop_node.operand);
+    visit_child(*unop_node.operand);
     branches.pop_back();
   }
   // indent -= indent_size;
@@ -96,17 +104,27 @@ template <typename T> void pretty_printer<T>::visit(unop_expr& unop_node) {
 
 template <typename T> void pretty_printer<T>::visit(float_lit& float_node) {
   const module::span& loc = this->abs_syntax.token_locs[float_node.main_token];
-  fmt::format_to(out, "FloatLiteral `{:s}`", loc.contents());
+  fmt::format_to(out, "FloatLiteral `{:s}`", loc.contents(this->abs_syntax.text));
   print_loc(loc);
 }
 
 template <typename T> void pretty_printer<T>::visit(int_lit& int_node) {
   // fmt::print("`pretty_printer<T>::visit(int_lit&)`: start of function\n");
   const module::span& loc = this->abs_syntax.token_locs[int_node.main_token];
-  fmt::format_to(out, "IntLiteral `{:s}`", loc.contents());
+  fmt::format_to(out, "IntLiteral `{:s}`", loc.contents(this->abs_syntax.text));
   print_loc(loc);
 }
 
+// A child is on the level of the last branch, and its subtree is only counted when it is too deep.
+template <typename T> void pretty_printer<T>::visit_child(node& child) {
+  if (branches.size() <= max_depth) {
+    visitor<pretty_printer>::visit(child);
+    return;
+  }
+  (fmt::format_to
+    (out, "... {} nodes deeper than {} levels not shown\n", flatten(&child).size(), max_depth));
+}
+
 template <typename T> void pretty_printer<T>::print_branches() const {
   for (auto branch_type : branches) {
     fmt::format_to(out, "{} ", branch_type);
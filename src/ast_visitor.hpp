@@ -2,6 +2,7 @@
 #define AST_VISITOR_H
 
 #include "ast.hpp"
+#include "flat_ast.hpp"
 
 namespace ast {
 
@@ -98,6 +99,47 @@ template <typename Derived> void visitor<Derived>::visit(unop_expr& unop_node) {
 template <typename Derived> void visitor<Derived>::visit(int_lit& int_node) {}
 template <typename Derived> void visitor<Derived>::visit(float_lit& float_node) {}
 
+
+// A visitor of a `flat_tree`, which is given the index of each node instead of a reference to it.
+// As with `visitor`, a derived visitor defines the `visit_*` methods for the kinds of nodes that it
+// handles and visits their children itself. A visitor that does not need the shape of the tree
+// can instead loop over the indices in order, which visits every child before its parent.
+template <typename Derived> struct flat_visitor {
+  const tree& abs_syntax; // The tokens that the nodes refer to.
+  const flat_tree& nodes;
+
+  flat_visitor(const tree& abs_syntax, const flat_tree& nodes)
+    : abs_syntax(abs_syntax), nodes(nodes) {}
+
+  void traverse_ast();
+  void visit(node_index idx);
+  void visit_binop_expr(node_index idx) {}
+  void visit_unop_expr(node_index idx) {}
+  void visit_ident(node_index idx) {}
+  void visit_int_lit(node_index idx) {}
+  void visit_float_lit(node_index idx) {}
+private:
+  Derived& derived() { return *static_cast<Derived*>(this); }
+};
+
+template <typename Derived> void flat_visitor<Derived>::traverse_ast() {
+  visit(nodes.root());
+}
+
+// Missing children are skipped, so a derived visitor can visit both children of a node as they are.
+template <typename Derived> void flat_visitor<Derived>::visit(node_index idx) {
+  if (idx == no_node) {
+    return;
+  }
+  switch (nodes.types[idx]) {
+    case node_type::binop_expr: derived().visit_binop_expr(idx); break;
+    case node_type::unop_expr: derived().visit_unop_expr(idx); break;
+    case node_type::ident: derived().visit_ident(idx); break;
+    case node_type::int_lit: derived().visit_int_lit(idx); break;
+    case node_type::float_lit: derived().visit_float_lit(idx); break;
+  }
+}
+
 } // End `ast` namespace.
 
 #endif
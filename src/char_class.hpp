@@ -0,0 +1,39 @@
+#ifndef CHAR_CLASS_H
+#define CHAR_CLASS_H
+#include <array>
+#include <cstdint>
+
+// A table that maps every byte to the set of lexical classes that it belongs to. Testing a byte
+// against a class is a single load and mask instead of a chain of comparisons.
+namespace char_class {
+
+enum : uint8_t {
+  whitespace  = 1 << 0, // ' ', '\t', '\n', '\v', '\f', '\r'
+  ident_start = 1 << 1, // 'a'..'z', 'A'..'Z', '_'
+  ident       = 1 << 2, // 'a'..'z', 'A'..'Z', '_', '0'..'9'
+  decimal     = 1 << 3, // '0'..'9'
+};
+
+constexpr std::array<uint8_t, 256> table = []{
+  std::array<uint8_t, 256> table{};
+  for (auto ch : {' ', '\t', '\n', '\v', '\f', '\r'}) {
+    table[uint8_t(ch)] |= whitespace;
+  }
+  for (int ch = 'a'; ch <= 'z'; ch++) {
+    table[ch] |= ident_start | ident;
+    table[ch - 'a' + 'A'] |= ident_start | ident;
+  }
+  table['_'] |= ident_start | ident;
+  for (int ch = '0'; ch <= '9'; ch++) {
+    table[ch] |= ident | decimal;
+  }
+  return table;
+}();
+
+constexpr bool is(char ch, uint8_t classes) {
+  return table[uint8_t(ch)] & classes;
+}
+
+} // End `char_class` namespace.
+
+#endif
@@ -29,11 +29,17 @@ bool operator==(const error_type& lhs, const error_type& rhs) {
   switch (lhs.tag) {
     case unknown_char: return lhs.ch == rhs.ch;
     case invalid_num_lit: return lhs.info == rhs.info;
+    case expected_token: return lhs.token == rhs.token;
     default: return false;
   }
 }
 
 
+error_phase phase_of(const error_type& kind) {
+  return kind.tag == error_type::reason::expected_token ? error_phase::parsing : error_phase::lexing;
+}
+
+
 void error::simple_error(std::string_view msg) {
   fmt::text_style style = stderr_has_color() ? err_style : no_style;
   fmt::print(stderr, "{} {}\n", fmt::format(style, "error:"), msg);
@@ -33,6 +33,7 @@ struct error_type {
     missing_fraction_part,
     missing_exponent,
     unknown_radix_prefix,
+    int_literal_overflow,
   };
 
   reason tag;
@@ -45,23 +46,34 @@ struct error_type {
 
 bool operator==(const error_type& lhs, const error_type& rhs);
 
+// The phase that reports an error. After an edit, each phase reports errors again only for the part
+// of the source that it goes over again, so each discards only its own old errors there.
+enum class error_phase : uint8_t {
+  lexing,
+  parsing,
+};
+
+error_phase phase_of(const error_type& kind);
+
 
-// An error has a msg, a starting line number, a number of lines, and a file_pos. By default, the
-// starting line number = the line number of the file_pos and the num_lines = 1. This way a range
-// of lines can be displayed with the specific location of the error marked. It would also be good
-// to add a way to suplement the error with additional notes that could be associated with a
-// location if desired. Using these additional notes, different, but associated lines could be shown
-// together to enhance the quality of the error messsage.
+// An error has a msg, a span, a starting line number, and a number of lines. By default, the
+// starting line number is the line of the span (recorded as 0) and the num_lines = 1. This way a
+// range of lines can be displayed with the specific location of the error marked. The span is only
+// converted to a line and column when the error is displayed, so that all of the errors of a source
+// are converted together. It would also be good to add a way to suplement the error with
+// additional notes that could be associated with a location if desired. Using these additional
+// notes, different, but associated lines could be shown together to enhance the quality of the
+// error messsage.
 struct error {
   error_type kind;
-  module::file_pos pos;
-  uint32_t line_no = pos.line_no;
+  module::span loc;
+  uint32_t line_no = 0;
   uint32_t num_lines = 1;
 
-  error(error_type kind, module::file_pos pos) : kind(std::move(kind)), pos(std::move(pos)) {}
-  error(error_type kind, module::file_pos pos, uint32_t line_no, uint32_t num_lines)
+  error(error_type kind, module::span loc) : kind(std::move(kind)), loc(loc) {}
+  error(error_type kind, module::span loc, uint32_t line_no, uint32_t num_lines)
     : kind(std::move(kind)),
-      pos(std::move(pos)),
+      loc(loc),
       line_no(line_no),
       num_lines(num_lines) {}
 
@@ -88,6 +100,7 @@ template <> struct fmt::formatter<error_type::detail>: formatter<string_view> {
       case missing_fraction_part: repr = "expected fraction part"; break;
       case missing_exponent: repr = "expected exponent"; break;
       case unknown_radix_prefix: repr = "unknown radix prefix"; break;
+      case int_literal_overflow: repr = "value does not fit in 64 bits"; break;
       default: repr = ""; break;
     }
     return fmt::formatter<string_view>::format(repr, ctx);
@@ -0,0 +1,262 @@
+#include "flat_ast.hpp"
+#include "ast_visitor.hpp"
+#include "parser.hpp"
+#include "doctest.hpp"
+
+#include <algorithm>
+#include <fmt/core.h>
+
+namespace ast {
+
+size_t flat_tree::num_bytes() const {
+  return
+    types.size() * sizeof(node_type) + ops.size() * sizeof(uint8_t) +
+    main_tokens.size() * sizeof(token_index) + children.size() * sizeof(children[0]);
+}
+
+void flat_tree::push_back
+  (node_type type,
+   uint8_t op,
+   token_index main_token,
+   node_index lhs,
+   node_index rhs) {
+  types.push_back(type);
+  ops.push_back(op);
+  main_tokens.push_back(main_token);
+  children.push_back({lhs, rhs});
+}
+
+bool flat_tree::is_well_formed(size_t num_tokens) const {
+  const size_t num_nodes = size();
+  if (ops.size() != num_nodes || main_tokens.size() != num_nodes || children.size() != num_nodes) {
+    return false;
+  }
+  std::vector<bool> is_child(num_nodes);
+  for (size_t i = 0; i < num_nodes; i++) {
+    if (main_tokens[i] >= num_tokens) {
+      return false;
+    }
+    const auto [lhs, rhs] = children[i];
+    switch (types[i]) {
+      case node_type::binop_expr:
+        if (ops[i] > uint8_t(binop::div)) {
+          return false;
+        }
+        break;
+      case node_type::unop_expr:
+        if (ops[i] > uint8_t(unop::logical_not) || rhs != no_node) {
+          return false;
+        }
+        break;
+      case node_type::ident:
+      case node_type::int_lit:
+      case node_type::float_lit:
+        if (ops[i] != 0 || lhs != no_node || rhs != no_node) {
+          return false;
+        }
+        break;
+      default:
+        return false;
+    }
+    for (node_index child : children[i]) {
+      if (child == no_node) {
+        continue;
+      }
+      if (child >= i || is_child[child]) {
+        return false;
+      }
+      is_child[child] = true;
+    }
+  }
+  return
+    num_nodes == 0
+    || size_t(std::count(is_child.begin(), is_child.end(), true)) == num_nodes - 1;
+}
+
+bool operator==(const flat_tree& lhs, const flat_tree& rhs) {
+  return
+    lhs.types == rhs.types && lhs.ops == rhs.ops && lhs.main_tokens == rhs.main_tokens &&
+    lhs.children == rhs.children;
+}
+
+// A node is added once both of its children have been, so the walk keeps a stack of the nodes
+// whose children are still being added and a stack of the indices of finished subtrees.
+flat_tree flatten(const node* root) {
+  struct frame {
+    const node* cur;
+    bool children_pushed;
+  };
+  flat_tree out;
+  std::vector<frame> pending = {{root, false}};
+  std::vector<node_index> finished;
+  while (!pending.empty()) {
+    const frame top = pending.back();
+    if (!top.cur) {
+      pending.pop_back();
+      finished.push_back(no_node);
+      continue;
+    }
+    if (!top.children_pushed) {
+      pending.back().children_pushed = true;
+      if (top.cur->type == node_type::binop_expr) {
+        const auto& binop = static_cast<const binop_expr&>(*top.cur);
+        pending.push_back({binop.rhs, false});
+        pending.push_back({binop.lhs, false});
+      } else if (top.cur->type == node_type::unop_expr) {
+        pending.push_back({static_cast<const unop_expr&>(*top.cur).operand, false});
+      }
+      continue;
+    }
+    pending.pop_back();
+    node_index lhs = no_node;
+    node_index rhs = no_node;
+    uint8_t op = 0;
+    if (top.cur->type == node_type::binop_expr) {
+      op = uint8_t(static_cast<const binop_expr&>(*top.cur).op);
+      rhs = finished.back();
+      finished.pop_back();
+      lhs = finished.back();
+      finished.pop_back();
+    } else if (top.cur->type == node_type::unop_expr) {
+      op = uint8_t(static_cast<const unop_expr&>(*top.cur).op);
+      lhs = finished.back();
+      finished.pop_back();
+    }
+    out.push_back(top.cur->type, op, top.cur->main_token, lhs, rhs);
+    finished.push_back(out.size() - 1);
+  }
+  return out;
+}
+
+node* unflatten(const flat_tree& nodes, arena& dest) {
+  std::vector<node*> made(nodes.size());
+  auto child = [&](node_index idx) { return idx == no_node ? nullptr : made[idx]; };
+  for (size_t i = 0; i < nodes.size(); i++) {
+    const auto [lhs, rhs] = nodes.children[i];
+    switch (nodes.types[i]) {
+      case node_type::binop_expr:
+        (made[i] = dest.make<binop_expr>
+          (binop(nodes.ops[i]), nodes.main_tokens[i], child(lhs), child(rhs)));
+        break;
+      case node_type::unop_expr:
+        made[i] = dest.make<unop_expr>(unop(nodes.ops[i]), nodes.main_tokens[i], child(lhs));
+        break;
+      case node_type::ident:
+        made[i] = dest.make<node>(node_type::ident, nodes.main_tokens[i]);
+        break;
+      case node_type::int_lit:
+        made[i] = dest.make<int_lit>(nodes.main_tokens[i]);
+        break;
+      case node_type::float_lit:
+        made[i] = dest.make<float_lit>(nodes.main_tokens[i]);
+        break;
+    }
+  }
+  return made.empty() ? nullptr : made.back();
+}
+
+} // End `ast` namespace.
+
+
+//------------------------------------------------------------------------------------------------//
+#if !defined(DOCTEST_CONFIG_DISABLE)
+TEST_SUITE_BEGIN("parsing");
+
+namespace {
+
+// Writes a tree as an s-expression of its lexemes.
+struct sexpr_printer : ast::flat_visitor<sexpr_printer> {
+  std::string out;
+
+  using flat_visitor::flat_visitor;
+
+  std::string_view lexeme(ast::node_index idx) const {
+    return abs_syntax.token_locs[nodes.main_tokens[idx]].contents(abs_syntax.text);
+  }
+
+  void visit_binop_expr(ast::node_index idx) {
+    out += fmt::format("({} ", lexeme(idx));
+    visit(nodes.children[idx][0]);
+    out += ' ';
+    visit(nodes.children[idx][1]);
+    out += ')';
+  }
+  void visit_unop_expr(ast::node_index idx) {
+    out += fmt::format("({} ", lexeme(idx));
+    visit(nodes.children[idx][0]);
+    out += ')';
+  }
+  void visit_ident(ast::node_index idx) { out += lexeme(idx); }
+  void visit_int_lit(ast::node_index idx) { out += lexeme(idx); }
+  void visit_float_lit(ast::node_index idx) { out += lexeme(idx); }
+};
+
+} // End unnamed namespace.
+
+TEST_CASE("flat trees") {
+  using namespace ast;
+  parsing::parser_test_source source("-(alpha + 2) * 3.5 / !beta");
+  parsing::parser(source).parse();
+  const tree& parsed = *source.abs_syntax;
+  const flat_tree nodes = flatten(parsed.root);
+
+  // Children come before their parents, and the lhs of a node before its rhs.
+  using enum node_type;
+  (CHECK
+    (nodes.types
+       == std::vector<node_type>
+            {ident, int_lit, binop_expr, unop_expr, float_lit, binop_expr, ident, unop_expr,
+             binop_expr}));
+  CHECK(nodes.main_tokens == std::vector<token_index>{2, 4, 3, 0, 7, 6, 10, 9, 8});
+  CHECK(nodes.children[2] == std::array<node_index, 2>{0, 1});
+  CHECK(nodes.children[3] == std::array<node_index, 2>{2, no_node});
+  CHECK(nodes.children[8] == std::array<node_index, 2>{5, 7});
+  CHECK(nodes.ops[8] == uint8_t(binop::div));
+  CHECK(nodes.root() == 8);
+  CHECK(nodes.num_bytes() == 9 * 14);
+  CHECK(nodes.is_well_formed(parsed.tokens.size()));
+
+  sexpr_printer printer(parsed, nodes);
+  printer.traverse_ast();
+  CHECK(printer.out == "(/ (* (- (+ alpha 2)) 3.5) (! beta))");
+
+  // A copy is a tree of its own, and converting back gives the same nodes.
+  const flat_tree copy = nodes;
+  CHECK(copy == nodes);
+  arena rebuilt_nodes;
+  node* rebuilt = unflatten(copy, rebuilt_nodes);
+  const tree rebuilt_tree(rebuilt, {}, parsed.text, parsed.tokens, parsed.token_locs);
+  CHECK(rebuilt_tree == parsed);
+  CHECK(flatten(rebuilt) == nodes);
+
+  // A missing operand is kept as `no_node`.
+  parsing::parser_test_source unfinished("1 +");
+  parsing::parser(unfinished).parse();
+  const flat_tree partial = flatten(unfinished.abs_syntax->root);
+  CHECK(partial.children.back() == std::array<node_index, 2>{0, no_node});
+  CHECK(partial.is_well_formed(unfinished.abs_syntax->tokens.size()));
+  CHECK(flatten(nullptr).root() == no_node);
+
+  // Children that come after their parent, or that have two parents, are rejected.
+  flat_tree bad = nodes;
+  bad.children[2] = {0, 4};
+  CHECK(!bad.is_well_formed(parsed.tokens.size()));
+  bad = nodes;
+  bad.children[5] = {2, 4};
+  CHECK(!bad.is_well_formed(parsed.tokens.size()));
+  bad = nodes;
+  bad.types[4] = node_type(9);
+  CHECK(!bad.is_well_formed(parsed.tokens.size()));
+  bad = nodes;
+  bad.ops.pop_back();
+  CHECK(!bad.is_well_formed(parsed.tokens.size()));
+
+  // So are main tokens past the end of the tokens.
+  CHECK(!nodes.is_well_formed(10));
+  bad = nodes;
+  bad.main_tokens[0] = token_index(parsed.tokens.size());
+  CHECK(!bad.is_well_formed(parsed.tokens.size()));
+}
+
+TEST_SUITE_END();
+#endif
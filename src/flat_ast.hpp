@@ -0,0 +1,56 @@
+#ifndef FLAT_AST_H
+#define FLAT_AST_H
+#include "ast.hpp"
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace ast {
+
+typedef uint32_t node_index;
+
+// The index of a missing child, such as the operand of an operator that ends a source.
+constexpr node_index no_node = std::numeric_limits<node_index>::max();
+
+// The nodes of a tree in parallel arrays, where a node is an index and refers to its children by
+// their indices. Every node takes 14 bytes, and a tree is a handful of arrays of plain integers, so
+// it can be written to a file as it is, moved anywhere in memory, copied with a few `memcpy`s, and
+// read by many threads at once.
+//
+// Nodes are in postorder: every node comes after its children and the root is the last node. A
+// pass over the arrays in order therefore visits children before their parents without a stack.
+// The tokens that nodes refer to stay in the `tree` that the nodes were made from.
+struct flat_tree {
+  std::vector<node_type> types;
+  std::vector<uint8_t> ops; // The `binop` or `unop` of an operator node, and 0 for other nodes.
+  std::vector<token_index> main_tokens;
+  // The lhs and rhs of a binary operator, the operand and `no_node` of a unary operator, and
+  // `no_node` twice for other nodes.
+  std::vector<std::array<node_index, 2>> children;
+
+  size_t size() const { return types.size(); }
+  node_index root() const { return types.empty() ? no_node : types.size() - 1; }
+  size_t num_bytes() const;
+
+  void push_back
+    (node_type type, uint8_t op, token_index main_token, node_index lhs, node_index rhs);
+
+  // Check that the arrays are the same size, that every type is known, that every main token is
+  // one of the `num_tokens` tokens of the tree, and that every node except the root is the child of
+  // exactly one node that comes after it. A tree read from a file must be checked before it is used.
+  bool is_well_formed(size_t num_tokens) const;
+};
+
+bool operator==(const flat_tree& lhs, const flat_tree& rhs);
+
+// The nodes of `root` and its descendants.
+flat_tree flatten(const node* root);
+
+// Make the nodes of `nodes`, which must be well formed, in `dest` and return the root.
+node* unflatten(const flat_tree& nodes, arena& dest);
+
+} // End `ast` namespace.
+
+#endif
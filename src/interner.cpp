@@ -0,0 +1,102 @@
+#include "interner.hpp"
+#include "doctest.hpp"
+
+#include <algorithm>
+#include <string>
+#include <fmt/core.h>
+
+symbol interner::intern(std::string_view name) {
+  return intern(name, hash(name.data(), name.size()));
+}
+
+symbol interner::intern(std::string_view name, uint32_t hash) {
+  // Keep the table at most half full so that probe sequences stay short.
+  if (2 * (names.size() + 1) > slots.size()) {
+    grow();
+  }
+  const size_t mask = slots.size() - 1;
+  for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+    slot& cur = slots[i];
+    if (cur.id == no_symbol) {
+      cur = {hash, symbol(names.size())};
+      names.push_back(store(name));
+      return cur.id;
+    }
+    if (cur.hash == hash && names[cur.id] == name) {
+      return cur.id;
+    }
+  }
+}
+
+std::string_view interner::name(symbol id) const { return names[id]; }
+
+size_t interner::size() const { return names.size(); }
+
+std::string_view interner::store(std::string_view name) {
+  char* dest;
+  if (name.size() > block_size) {
+    // A name longer than a block gets a block of its own, and the current block stays in use.
+    std::unique_ptr<char[]> own(new char[name.size()]);
+    dest = own.get();
+    blocks.insert(blocks.end() - (blocks.empty() ? 0 : 1), std::move(own));
+  } else {
+    if (blocks.empty() || name.size() > block_size - block_used) {
+      blocks.emplace_back(new char[block_size]);
+      block_used = 0;
+    }
+    dest = blocks.back().get() + block_used;
+    block_used += name.size();
+  }
+  std::memcpy(dest, name.data(), name.size());
+  return std::string_view(dest, name.size());
+}
+
+void interner::grow() {
+  std::vector<slot> old = std::move(slots);
+  slots.assign(std::max(initial_num_slots, 2 * old.size()), {0, no_symbol});
+  const size_t mask = slots.size() - 1;
+  for (const slot& cur : old) {
+    if (cur.id == no_symbol) {
+      continue;
+    }
+    size_t i = cur.hash & mask;
+    while (slots[i].id != no_symbol) {
+      i = (i + 1) & mask;
+    }
+    slots[i] = cur;
+  }
+}
+
+
+//------------------------------------------------------------------------------------------------//
+#if !defined(DOCTEST_CONFIG_DISABLE)
+TEST_SUITE_BEGIN("interning");
+
+TEST_CASE("interner") {
+  interner symbols;
+  CHECK(symbols.intern("alpha") == 0);
+  CHECK(symbols.intern("beta") == 1);
+  CHECK(symbols.intern("alpha") == 0);
+  CHECK(symbols.intern(std::string(70000, 'x')) == 2);
+  CHECK(symbols.intern("a_name_that_is_longer_than_eight_bytes") == 3);
+  CHECK(symbols.intern("a_name_that_is_longer_than_eight_bytez") == 4);
+  CHECK(symbols.size() == 5);
+
+  // Symbols stay dense and names stay valid as the table grows.
+  const std::string_view first = symbols.name(0);
+  for (int i = 0; i < 20000; i++) {
+    CHECK(symbols.intern(fmt::format("tmp_{}", i)) == symbol(5 + i));
+  }
+  for (int i = 0; i < 20000; i += 97) {
+    std::string name = fmt::format("tmp_{}", i);
+    CHECK(symbols.intern(name, interner::hash(name.data(), name.size())) == symbol(5 + i));
+    CHECK(symbols.name(5 + i) == name);
+  }
+  CHECK(first.data() == symbols.name(0).data());
+  CHECK(symbols.name(0) == "alpha");
+  CHECK(symbols.name(2) == std::string(70000, 'x'));
+  CHECK(symbols.size() == 20005);
+}
+
+TEST_SUITE_END();
+#endif
@@ -0,0 +1,77 @@
+#ifndef INTERNER_H
+#define INTERNER_H
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// The dense id of a distinct identifier. Symbols are numbered from zero in the order that their
+// names are first interned.
+typedef uint32_t symbol;
+
+// Maps each distinct identifier to a `symbol`, so that the phases after lexing compare names as
+// integers instead of as strings. The table is open addressed with linear probing, and a slot holds
+// only a hash and a symbol, so most probes touch a single cache line and never touch the name
+// itself. Names are copied into blocks that never move, so a view returned by `name` stays valid
+// for the life of the interner.
+//
+// One interner can be shared by the parsers of many sources, as long as they do not run at the same
+// time, so that a name has the same symbol in every source.
+class interner {
+public:
+  static constexpr symbol no_symbol = UINT32_MAX;
+
+  // The hash of an identifier. The lexer computes it while the identifier is still in cache, right
+  // after finding its end.
+  static uint32_t hash(const char* str, size_t len);
+
+  symbol intern(std::string_view name);
+  // Intern a name whose `hash` is already known.
+  symbol intern(std::string_view name, uint32_t hash);
+
+  std::string_view name(symbol id) const;
+  size_t size() const;
+
+private:
+  struct slot {
+    uint32_t hash;
+    symbol id;
+  };
+
+  static constexpr size_t initial_num_slots = 1024;
+  static constexpr size_t block_size = 1 << 16;
+
+  std::vector<slot> slots;
+  std::vector<std::string_view> names;
+  std::vector<std::unique_ptr<char[]>> blocks;
+  size_t block_used = block_size;
+
+  std::string_view store(std::string_view name);
+  void grow();
+};
+
+// Identifiers are hashed eight bytes at a time. The bytes past the end of an identifier are never
+// read, since the last bytes of a source may be the last bytes of a buffer.
+inline uint32_t interner::hash(const char* str, size_t len) {
+  uint64_t hash = len * 0x9e3779b97f4a7c15;
+  auto mix = [&](uint64_t word) {
+    hash = (hash ^ word) * 0xff51afd7ed558ccd;
+    hash ^= hash >> 29;
+  };
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    uint64_t word;
+    std::memcpy(&word, str + i, 8);
+    mix(word);
+  }
+  if (i < len) {
+    uint64_t word = 0;
+    std::memcpy(&word, str + i, len - i);
+    mix(word);
+  }
+  return uint32_t(hash ^ hash >> 32);
+}
+
+#endif
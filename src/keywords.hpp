@@ -0,0 +1,141 @@
+#ifndef KEYWORDS_H
+#define KEYWORDS_H
+#include "token.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+// Keywords are recognized with a perfect hash table that is built at compile time from `list`, the
+// only place that a keyword is declared. The table is built with hash and displace: every word is
+// first hashed to a bucket, and each bucket is given the displacement that moves its words into
+// free slots. A lookup is then two hashes, two loads, and one comparison no matter how many
+// keywords there are.
+namespace keywords {
+
+struct entry {
+  std::string_view name;
+  token::type kind;
+};
+
+constexpr std::array list = {
+  entry{"def", token::type::keyword_def},
+  entry{"extern", token::type::keyword_extern},
+};
+
+// A word is hashed by its length and four of its bytes rather than by all of them, so that the
+// hash of an identifier costs the same no matter its length. A one byte word has no second byte,
+// so 0 is hashed in its place rather than whatever byte follows the word.
+constexpr uint64_t key(const char* str, size_t len) {
+  return
+    uint64_t(uint8_t(str[0])) |
+    uint64_t(len > 1 ? uint8_t(str[1]) : 0) << 8 |
+    uint64_t(uint8_t(str[len / 2])) << 16 |
+    uint64_t(uint8_t(str[len - 1])) << 24 |
+    uint64_t(len) << 32;
+}
+
+constexpr uint32_t mix(uint64_t key, uint64_t seed) {
+  uint64_t hash = (key ^ seed) * 0xff51afd7ed558ccd;
+  return uint32_t(hash ^ hash >> 33);
+}
+
+template <size_t N> class table {
+public:
+  static constexpr size_t num_slots = std::bit_ceil(2 * N);
+  static constexpr size_t num_buckets = std::bit_ceil((N + 1) / 2);
+
+  // False if two words share a key, or if no displacement could be found for some bucket. Either
+  // one stops the build of a table that is used in a constant expression.
+  bool collision_free = true;
+
+  constexpr table(const std::array<entry, N>& words) {
+    slots.fill({"", token::type::ident});
+
+    std::array<uint64_t, N> keys{};
+    for (size_t i = 0; i < N; i++) {
+      keys[i] = key(words[i].name.data(), words[i].name.size());
+      for (size_t j = 0; j < i; j++) {
+        if (keys[i] == keys[j]) {
+          collision_free = false;
+          return;
+        }
+      }
+    }
+
+    // Place the largest buckets first, while most slots are still free.
+    std::array<std::array<size_t, N>, num_buckets> buckets{};
+    std::array<size_t, num_buckets> bucket_sizes{};
+    for (size_t i = 0; i < N; i++) {
+      size_t bucket = mix(keys[i], 0) & (num_buckets - 1);
+      buckets[bucket][bucket_sizes[bucket]++] = i;
+    }
+    std::array<size_t, num_buckets> order{};
+    for (size_t i = 0; i < num_buckets; i++) {
+      order[i] = i;
+    }
+    (std::sort
+      (order.begin(), order.end(),
+       [&](size_t a, size_t b) { return bucket_sizes[a] > bucket_sizes[b]; }));
+
+    std::array<bool, num_slots> taken{};
+    for (size_t bucket : order) {
+      if (bucket_sizes[bucket] == 0) {
+        break;
+      }
+      bool placed = false;
+      for (uint64_t displacement = 1; !placed && displacement <= max_displacement; displacement++) {
+        const uint64_t seed = displacement * 0x9e3779b97f4a7c15;
+        std::array<size_t, N> targets{};
+        placed = true;
+        for (size_t i = 0; placed && i < bucket_sizes[bucket]; i++) {
+          targets[i] = mix(keys[buckets[bucket][i]], seed) & (num_slots - 1);
+          placed = !taken[targets[i]];
+          for (size_t j = 0; placed && j < i; j++) {
+            placed = targets[i] != targets[j];
+          }
+        }
+        if (placed) {
+          seeds[bucket] = seed;
+          for (size_t i = 0; i < bucket_sizes[bucket]; i++) {
+            taken[targets[i]] = true;
+            slots[targets[i]] = words[buckets[bucket][i]];
+          }
+        }
+      }
+      if (!placed) {
+        collision_free = false;
+        return;
+      }
+    }
+  }
+
+  // The kind of keyword that `str` is, or `token::type::ident` if it is not one.
+  constexpr token::type find(const char* str, size_t len) const {
+    const uint64_t k = key(str, len);
+    const entry& slot = slots[mix(k, seeds[mix(k, 0) & (num_buckets - 1)]) & (num_slots - 1)];
+    return slot.name.size() == len && std::string_view(str, len) == slot.name
+      ? slot.kind
+      : token::type::ident;
+  }
+
+private:
+  static constexpr uint64_t max_displacement = 1 << 16;
+
+  std::array<uint64_t, num_buckets> seeds{};
+  std::array<entry, num_slots> slots{};
+};
+
+inline constexpr table<list.size()> lookup(list);
+static_assert(lookup.collision_free, "keywords must differ in length or in a hashed byte");
+
+inline token::type get_token(const char* str, size_t len) {
+  return lookup.find(str, len);
+}
+
+} // End `keywords` namespace.
+
+#endif
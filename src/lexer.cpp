@@ -1,11 +1,18 @@
 #include "lexer.hpp"
-#include "lexer_patterns.hpp"
+#include "char_class.hpp"
 #include "error.hpp"
-#include "keyhash.hpp"
+#include "interner.hpp"
+#include "keywords.hpp"
+#include "num_lit_value.hpp"
 #include "parser.hpp"
+#include "parallel_lexer.hpp"
+#include "scan.hpp"
+#include "stream.hpp"
 #include "doctest.hpp"
 
+#include <algorithm>
 #include <optional>
+#include <random>
 #include <fmt/core.h>
 #include <fmt/compile.h>
 
@@ -19,39 +26,45 @@ template <lexable T> char lexer<T>::peek_next() const {
 
 template <lexable T> char lexer<T>::next() { return *current++; }
 
+template <lexable T>
+module::span lexer<T>::make_span(const char* lo, const char* hi) const {
+  return module::span(lo - source_start, hi - lo);
+}
+
 template <lexable T> token lexer<T>::make_token(token::type kind) const {
-  return token(kind, module::span(start, current));
+  return token(kind, make_span(start, current));
 }
 
 template <lexable T> void lexer<T>::mark_error(error_type kind) {
-  source.mark_error(std::move(kind), module::span(current, current + 1));
+  source.mark_error(std::move(kind), make_span(current, current + 1));
 }
 
+// Runs of whitespace and the bodies of line comments are skipped by the vectorized kernels in
+// `scan`. Lines are not recorded here; see `module::line_table`.
 template <lexable T> void lexer<T>::consume_whitespace() {
   for (;;) {
     switch (peek()) {
       case '/':
         // Handle line comments.
-        if (peek_next() == '/') {
-          current += 2;
-          while (peek() != '\n' && peek() != '\0') {
-            next();
-          };
-        } else {
+        if (peek_next() != '/') {
           return;
         }
-        // Fallthrough enabled because the current character is either '\n' or '\0'. It is useful to
-        // have the address of the second EOF byte in `line_offsets` because it removes an edge case;
-        // the address of the last character in any given line can be calculated with:
-        // `line_offsets[<line-number>] - 2`.
-      case '\n':
-        line_offsets.push_back(current + 1);
+        current = scan::find_line_end(current + 2);
+        break;
       case ' ':
+        // A lone space between two tokens is the most common run of whitespace, so it is skipped
+        // without a call to a vectorized kernel.
+        if (!char_class::is(peek_next(), char_class::whitespace)) {
+          next();
+          break;
+        }
+        [[fallthrough]];
+      case '\n':
       case '\t':
       case '\r':
       case '\f':
       case '\v':
-        next();
+        current = scan::skip_whitespace(current);
         break;
       default:
         return;
@@ -59,336 +72,70 @@ template <lexable T> void lexer<T>::consume_whitespace() {
   }
 }
 
-// Advance scanner while there is a valid identifier character.
+// Advance scanner while there is a valid identifier character. The identifier is hashed for
+// interning while its bytes are still in cache.
 template <lexable T> void lexer<T>::scan_ident_chars() {
-  for (;;) {
-    switch (peek()) {
-      ALPHA
-      DECIMAL
-      case '_':
-        next();
-        break;
-      default:
-        return;
-    }
-  }
+  current = scan::find_ident_end(current);
+  last_ident_hash = interner::hash(start, current - start);
 }
 
 template <lexable T> token lexer<T>::seen_keyword_char() {
   scan_ident_chars();
-  const auto loc = module::span(start, current);
-  return token(perfect_hash::get_token(start, loc.len()), loc);
+  const auto loc = make_span(start, current);
+  return token(keywords::get_token(start, loc.len), loc);
 }
 
-// Discard any further errors regarding the same literal after encountering an invalid digit.
+// Discard any further errors regarding the same literal after encountering an invalid digit. The
+// rest of the literal is every digit, letter, separator, and point that follows; a sign ends it,
+// even after an exponent.
 template <lexable T>
 void lexer<T>::consume_invalid_num_lit(error_type::detail cause) {
   mark_error({.tag = error_type::reason::invalid_num_lit, .info = cause});
   for (;;) {
-    switch (peek()) {
-      case 'e':
-      case 'p':
-      case 'E':
-      case 'P': {
-        // Scientific notation.
-        char ch = next();
-        if (ch == '-' || ch == '+') {
-          next();
-        }
-        break;
-      }
-      case '_':
-      case '.':
-      ALPHA_NON_SCI
-      DECIMAL
-        next();
-        break;
-      default:
-        return;
+    const num_lit::char_kind kind = num_lit::classes[uint8_t(peek())];
+    if (kind == num_lit::other || kind == num_lit::sign) {
+      return;
     }
+    next();
   }
 }
 
-// To enhance readability, digits may be separated by an underscore.
-#define OPTIONAL_DIGIT_SEP                                                                         \
-  case '_':                                                                                        \
-    next();                                                                                        \
-    switch (peek()) {                                                                              \
-      DECIMAL                                                                                      \
-        next();                                                                                    \
-        break;                                                                                     \
-      default:                                                                                     \
-        consume_invalid_num_lit(error_type::detail::non_dec_digit);                                \
-        return token::type::invalid;                                                               \
-    }
-
-// At this point, a radix point has already been seen and any additional '.' characters result in an
-// invalid literal.
-template <lexable T> token::type lexer<T>::scan_dec_digits() {
+// Run the numeric literal automaton from `state` until it either accepts or rejects the literal.
+template <lexable T> token::type lexer<T>::scan_num_lit(num_lit::state state) {
+  uint8_t action;
   for (;;) {
-    switch (peek()) {
-      // Valid literal character.
-      DECIMAL
-        next();
-        break;
-      OPTIONAL_DIGIT_SEP
-        break;
-      // Invalid literal character.
-      case '.':
-        consume_invalid_num_lit(error_type::detail::multiple_radix_points);
-        return token::type::invalid;
-      ALPHA
-        consume_invalid_num_lit(error_type::detail::non_dec_digit);
-        return token::type::invalid;
-      // End of valid literal.
-      default:
-        return token::type::float_literal;
-    }
-  }
-}
-
-// Hexadecimal floats written in scientific notation still have a decimal exponent.
-template <lexable T> token::type lexer<T>::seen_exponent_char() {
-  switch (peek()) {
-    DECIMAL
-    case '+':
-    case '-':
+    // Most of a literal is a run of digits that stays in the same state. Looping while the state is
+    // unchanged keeps the next lookup from depending on the result of the previous one.
+    const auto& row = num_lit::transitions[state];
+    while ((action = row[uint8_t(peek())]) == state) {
       next();
-      return scan_dec_digits();
-    ALPHA
-      // TODO: Is it more helpful to have this error specific to exponent?
-      // "error: invalid numeric literal: expected '+', '-', or a decimal digit"
-      consume_invalid_num_lit(error_type::detail::non_dec_digit);
-      return token::type::invalid;
-    default:
-      consume_invalid_num_lit(error_type::detail::missing_exponent);
-      return token::type::invalid;
-  }
-}
-
-template <lexable T> token::type lexer<T>::seen_dec_point() {
-  switch (peek()) {
-      DECIMAL
-      next();
-      for (;;) {
-        switch (peek()) {
-          DECIMAL
-            next();
-            break;
-          OPTIONAL_DIGIT_SEP
-            break;
-          case 'e':
-          case 'E':
-            next();
-            return seen_exponent_char();
-          case '.':
-            consume_invalid_num_lit(error_type::detail::multiple_radix_points);
-            return token::type::invalid;
-          ALPHA_NO_E
-            consume_invalid_num_lit(error_type::detail::non_dec_digit);
-            return token::type::invalid;
-          default:
-            return token::type::float_literal;
-        }
-      }
-    default:
-      consume_invalid_num_lit(error_type::detail::missing_fraction_part);
-      return token::type::invalid;
-  }
-}
-
-template <lexable T> token::type lexer<T>::seen_dec_digit() {
-  for (;;) {
-    switch (peek()) {
-      DECIMAL
-        next();
-        break;
-      OPTIONAL_DIGIT_SEP
-        break;
-      case '.':
-        next();
-        return seen_dec_point();
-      case 'e':
-      case 'E':
-        next();
-        return seen_exponent_char();
-      ALPHA_NO_E
-        consume_invalid_num_lit(error_type::detail::non_dec_digit);
-        return token::type::invalid;
-      default:
-        return token::type::int_literal;
     }
-  }
-}
-
-// Any non-binary alphanumeric character results in an invalid token.
-template <lexable T> token::type lexer<T>::seen_bin_lit_prefix() {
-  for (;;) {
-    switch (peek()) {
-      case '0':
-      case '1':
-        next();
-        break;
-      case '_':
-        next();
-        switch (peek()) {
-          case '0':
-          case '1':
-            next();
-            break;
-          default:
-            consume_invalid_num_lit(error_type::detail::non_bin_digit);
-            return token::type::invalid;
-        }
-        break;
-      case '2':
-      case '3':
-      case '4':
-      case '5':
-      case '6':
-      case '7':
-      case '8':
-      case '9':
-      ALPHA
-        consume_invalid_num_lit(error_type::detail::non_bin_digit);
-        return token::type::invalid;
-      default:
-        return token::type::int_literal;
+    if (action & num_lit::stop) {
+      break;
     }
+    next();
+    state = static_cast<num_lit::state>(action);
   }
-}
-
-// Any non-octal alphanumeric character results in an invalid token.
-template <lexable T> token::type lexer<T>::seen_oct_lit_prefix() {
-  for (;;) {
-    switch (peek()) {
-      OCTAL
-        next();
-        break;
-      case '_':
-        next();
-        switch (peek()) {
-          OCTAL
-            next();
-            break;
-          default:
-            consume_invalid_num_lit(error_type::detail::non_oct_digit);
-            return token::type::invalid;
-        }
-        break;
-      case '8':
-      case '9':
-      ALPHA
-        consume_invalid_num_lit(error_type::detail::non_oct_digit);
+  switch (action) {
+    // Values are decoded now, while the digits are in cache, rather than in a separate pass.
+    case num_lit::accept_int: {
+      const auto value = num_lit::decode_int(start, current);
+      if (!value) {
+        (source.mark_error
+          ({.tag = error_type::reason::invalid_num_lit,
+            .info = error_type::detail::int_literal_overflow},
+           make_span(start, current)));
         return token::type::invalid;
-      default:
-        return token::type::int_literal;
-    }
-  }
-}
-
-template <lexable T> token::type lexer<T>::seen_hex_point() {
-  switch (peek()) {
-    HEX
-      next();
-      for (;;) {
-        switch (peek()) {
-          HEX
-            next();
-            break;
-          case '_':
-            next();
-            switch (peek()) {
-              HEX
-                next();
-                break;
-              default:
-                consume_invalid_num_lit(error_type::detail::non_hex_digit);
-                return token::type::invalid;
-            }
-            break;
-          case 'p':
-          case 'P':
-            next();
-            return seen_exponent_char();
-          case '.':
-            consume_invalid_num_lit(error_type::detail::multiple_radix_points);
-            return token::type::invalid;
-            break;
-          ALPHA_NON_HEX_NO_P
-            consume_invalid_num_lit(error_type::detail::non_hex_digit);
-            return token::type::invalid;
-          default:
-            return token::type::float_literal;
-        }
       }
-    default:
-      consume_invalid_num_lit(error_type::detail::missing_fraction_part);
-      return token::type::invalid;
-  }
-}
-
-// Any non-hex alphanumeric character results in an invalid token.
-template <lexable T> token::type lexer<T>::seen_hex_lit_prefix() {
-  for (;;) {
-    switch (peek()) {
-      HEX
-        next();
-        break;
-      case '_':
-        next();
-        switch (peek()) {
-          HEX
-            next();
-            break;
-          default:
-            consume_invalid_num_lit(error_type::detail::non_hex_digit);
-            return token::type::invalid;
-        }
-        break;
-      case '.':
-        next();
-        return seen_hex_point();
-      case 'p':
-      case 'P':
-        next();
-        return seen_exponent_char();
-      ALPHA_NON_HEX_NO_P
-        consume_invalid_num_lit(error_type::detail::non_hex_digit);
-        return token::type::invalid;
-      default:
-        return token::type::int_literal;
+      last_int_value = *value;
+      return token::type::int_literal;
     }
-  }
-}
-
-template <lexable T> token::type lexer<T>::seen_zero() {
-  switch (peek()) {
-    DECIMAL
-      next();
-      return seen_dec_digit();
-    OPTIONAL_DIGIT_SEP
-      return seen_dec_digit();
-    case 'b':
-    case 'B':
-      next();
-      return seen_bin_lit_prefix();
-    case 'o':
-    case 'O':
-      next();
-      return seen_oct_lit_prefix();
-    case 'x':
-    case 'X':
-      next();
-      return seen_hex_lit_prefix();
-    case '.':
-      next();
-      return seen_dec_point();
-    ALPHA_NON_RADIX
-      consume_invalid_num_lit(error_type::detail::unknown_radix_prefix);
-      return token::type::invalid;
+    case num_lit::accept_float:
+      last_float_value = num_lit::decode_float(start, current);
+      return token::type::float_literal;
     default:
-      return token::type::int_literal;
+      consume_invalid_num_lit(num_lit::rejection_cause(action));
+      return token::type::invalid;
   }
 }
 
@@ -398,42 +145,12 @@ template <lexable T> token lexer<T>::next_token() {
   switch (next()) {
     case '\0':
       return make_token(token::type::eof);
-    case 'a':
-    case 'b':
-    case 'c':
-      scan_ident_chars();
-      return make_token(token::type::ident);
     case 'd':
     case 'e':
       // `def`, `extern`
       return seen_keyword_char();
-    case 'f':
-    case 'g':
-    case 'h':
-    case 'i':
-    case 'j':
-    case 'k':
-    case 'l':
-    case 'm':
-    case 'n':
-    case 'o':
-    case 'p':
-    case 'q':
-    case 'r':
-    case 's':
-    case 't':
-    case 'u':
-    case 'v':
-    case 'w':
-    case 'x':
-    case 'y':
-    case 'z':
-    case '_':
-    UPPER_ALPHA
-      scan_ident_chars();
-      return make_token(token::type::ident);
     case '0':
-      return make_token(seen_zero());
+      return make_token(scan_num_lit(num_lit::zero));
     case '1':
     case '2':
     case '3':
@@ -443,7 +160,7 @@ template <lexable T> token lexer<T>::next_token() {
     case '7':
     case '8':
     case '9':
-      return make_token(seen_dec_digit());
+      return make_token(scan_num_lit(num_lit::dec_int));
     case '+':
       return make_token(token::type::plus);
     case '-':
@@ -459,35 +176,171 @@ template <lexable T> token lexer<T>::next_token() {
     case ')':
       return make_token(token::type::right_paren);
     default:
+      // Every other letter and `_` starts an identifier that cannot be a keyword.
+      if (char_class::is(*start, char_class::ident_start)) {
+        scan_ident_chars();
+        return make_token(token::type::ident);
+      }
       (source.mark_error
         ({.tag = error_type::reason::unknown_char, .ch = *start},
-         module::span(start, current)));
+         make_span(start, current)));
       return make_token(token::type::invalid);
   }
 }
 
+namespace {
+// Replace the elements [first, last) of `vec` with `replacement`, moving the elements after them
+// at most once.
+template <typename V>
+void replace_range
+  (std::vector<V>& vec,
+   size_t first,
+   size_t last,
+   const std::vector<V>& replacement) {
+  const size_t num_replaced = last - first;
+  if (replacement.size() > num_replaced) {
+    vec.insert(vec.begin() + last, replacement.size() - num_replaced, V());
+  } else {
+    vec.erase(vec.begin() + first + replacement.size(), vec.begin() + last);
+  }
+  std::copy(replacement.begin(), replacement.end(), vec.begin() + first);
+}
+} // End unnamed namespace.
+
+template <editable T>
+uint32_t relex
+  (T& source,
+   const module::text_edit& edit,
+   std::vector<token::type>& tokens,
+   std::vector<module::span>& token_locs) {
+  // The lexer looks one byte past the end of a token to find where it ends, so the first token
+  // that may change is the first one that ends at or after the edit. Lexing resumes where the token
+  // before it ends, which also covers an edit to the whitespace or comment that follows it.
+  const auto first =
+    (std::partition_point
+      (token_locs.begin(), token_locs.end(),
+       [&](const module::span& loc) { return loc.hi() < edit.lo; }));
+  const size_t first_idx = first - token_locs.begin();
+  const uint32_t resume_offset = first_idx > 0 ? token_locs[first_idx - 1].hi() : 0;
+  source.apply_edit(edit);
+  const size_t num_old_errors = source.num_errors();
+
+  // The old tokens that start after the replaced bytes move by `shift`. Once a new token is the
+  // same as one of them, all of the tokens that follow it are the same as well.
+  const uint32_t old_edit_end = edit.lo + edit.len;
+  const uint32_t shift = edit.text.size() - edit.len; // Wraps around when text is removed.
+  std::vector<token::type> new_tokens;
+  std::vector<module::span> new_locs;
+  lexer scanner(source, resume_offset);
+  size_t old_idx = first_idx;
+  uint32_t lexed_end; // Where the last token lexed ends, which is as far as the scanner reported.
+  for (;;) {
+    const token cur = scanner.next_token();
+    lexed_end = cur.loc.hi();
+    while (old_idx < tokens.size()
+           && (token_locs[old_idx].lo < old_edit_end
+               || token_locs[old_idx].lo + shift < cur.loc.lo)) {
+      old_idx += 1;
+    }
+    if (old_idx < tokens.size()
+        && tokens[old_idx] == cur.kind
+        && token_locs[old_idx].lo + shift == cur.loc.lo
+        && token_locs[old_idx].len == cur.loc.len) {
+      break;
+    }
+    new_tokens.push_back(cur.kind);
+    new_locs.push_back(cur.loc);
+    if (cur.kind == token::type::eof) {
+      old_idx = tokens.size();
+      break;
+    }
+  }
+
+  // The lexing errors that the scanner went over again were either reported again or are gone. The
+  // byte at `resume_offset` comes before the edit, so an error there either belongs to the token
+  // before it or was reported again, and is only discarded in the second case.
+  const uint32_t stale_lo = std::min(resume_offset + 1, lexed_end);
+  (source.discard_errors
+    (error_phase::lexing, {stale_lo, lexed_end - stale_lo}, num_old_errors));
+  for (size_t i = old_idx; i < token_locs.size(); i++) {
+    token_locs[i].lo += shift;
+  }
+  replace_range(tokens, first_idx, old_idx, new_tokens);
+  replace_range(token_locs, first_idx, old_idx, new_locs);
+  return new_tokens.size();
+}
+
 
 // Declaring the specific `lexable` types used with `lexer<T>` allows the implementation of
 // `lexer<T>` to be separate from its declaration.
 template class lexer<module::file>;
+template class lexer<lex_chunk>;
+template class lexer<module::stream>;
 #if !defined(DOCTEST_CONFIG_DISABLE)
 template class lexer<parsing::parser_test_source>;
 #endif
 
+template uint32_t relex
+  (module::file&,
+   const module::text_edit&,
+   std::vector<token::type>&,
+   std::vector<module::span>&);
+#if !defined(DOCTEST_CONFIG_DISABLE)
+template uint32_t relex
+  (lexer_test_source&,
+   const module::text_edit&,
+   std::vector<token::type>&,
+   std::vector<module::span>&);
+template uint32_t relex
+  (parsing::parser_test_source&,
+   const module::text_edit&,
+   std::vector<token::type>&,
+   std::vector<module::span>&);
+#endif
+
 
 //------------------------------------------------------------------------------------------------//
 #if !defined(DOCTEST_CONFIG_DISABLE)
 lexer_test_source::lexer_test_source(const char* buf) : contents(buf) {
     contents.push_back('\0');
-    line_offsets.push_back(contents.c_str());
+    line_offsets = module::line_table(contents.data(), size());
 }
 
 const char* lexer_test_source::start() const { return contents.data(); }
 
+// Excludes the extra terminating null byte that is part of `contents`.
+size_t lexer_test_source::size() const { return contents.size() - 1; }
+
 bool lexer_test_source::has_error() const { return err_reason.has_value(); }
 
 void lexer_test_source::mark_error(error_type kind, const module::span& loc) {
   err_reason = kind;
+  errors.emplace_back(kind, loc);
+}
+
+void lexer_test_source::apply_edit(const module::text_edit& edit) {
+  std::erase_if(errors, [&](auto& err) {
+    const std::optional<module::span> moved = module::span_after_edit(err.second, edit);
+    err.second = moved.value_or(err.second);
+    return !moved;
+  });
+  contents.replace(edit.lo, edit.len, edit.text);
+  line_offsets.apply_edit(contents.data(), size(), edit);
+}
+
+size_t lexer_test_source::num_errors() const { return errors.size(); }
+
+void lexer_test_source::discard_errors
+  (error_phase phase, const module::span& range, size_t num_old) {
+  const auto old_end = errors.begin() + num_old;
+  auto is_stale = [&](const auto& err) {
+    return phase_of(err.first) == phase
+           && ((err.second.lo >= range.lo && err.second.lo < range.hi())
+               || std::find(old_end, errors.end(), err) != errors.end());
+  };
+  errors.erase(std::remove_if(errors.begin(), old_end, is_stale), old_end);
+  err_reason =
+    errors.empty() ? std::nullopt : std::optional<error_type>(errors.back().first);
 }
 
 namespace {
@@ -497,7 +350,7 @@ namespace {
     lexer lex = lexer(src);
     auto tok = lex.next_token();
     CHECK(tok.kind == expected);
-    CHECK(tok.lexeme() == text);
+    CHECK(tok.lexeme(src.start()) == text);
     CHECK(!src.has_error());
   }
 
@@ -509,6 +362,26 @@ namespace {
     REQUIRE(src.has_error());
     CHECK(src.err_reason == expected);
   }
+  // Lex all of `text` using the kernels for `level` and return the lexeme of every token along with
+  // the offset of every line start.
+  auto lex_all(scan::isa level, const char* text) {
+    scan::use_isa(level);
+    lexer_test_source src = lexer_test_source(text);
+    lexer lex = lexer(src);
+    std::vector<std::string> lexemes;
+    token tok;
+    do {
+      tok = lex.next_token();
+      lexemes.emplace_back(tok.lexeme(src.start()));
+    } while (tok.kind != token::type::eof);
+    CHECK(!src.line_offsets.is_built());
+    std::vector<std::ptrdiff_t> lines;
+    for (uint32_t line : src.line_offsets) {
+      lines.push_back(line);
+    }
+    scan::use_isa(scan::detected_isa());
+    return std::make_pair(lexemes, lines);
+  }
 } // End unnamed namespace.
 
 
@@ -530,11 +403,95 @@ TEST_CASE("punctuators") {
   test(right_paren, ")");
 }
 
+TEST_CASE("whitespace & comments") {
+  const char* texts[] = {
+    "",
+    "// comment at end of file",
+    "a // comment\n",
+    "a\n\n\nb",
+    " \t\r\f\v\n a  /  b",
+    "//\n//\n//\n  x\n",
+    "                                                                                  y   \n"
+    "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\n"
+    "// ========================================================================================\n"
+    "// ========================================================================================\n"
+    "\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n"
+    "    z // trailing ===================================================================",
+  };
+  for (const char* text : texts) {
+    CAPTURE(text);
+    const auto expected = lex_all(scan::isa::scalar, text);
+    for (auto level : {scan::isa::sse2, scan::isa::avx2, scan::isa::avx512}) {
+      CAPTURE(scan::isa_name(level));
+      CHECK(lex_all(level, text) == expected);
+    }
+  }
+  CHECK(lex_all(scan::isa::scalar, "a\n b\n").second == std::vector<std::ptrdiff_t>{0, 2, 5, 6});
+  CHECK(lex_all(scan::isa::scalar, "a // b").second == std::vector<std::ptrdiff_t>{0, 7});
+}
+
 TEST_CASE("keywords & identifiers") {
   test(keyword_def, "def");
   test(keyword_extern, "extern");
   test(ident, "_def");
   test(ident, "deff");
+  test(ident, "__tmp_reg_000123");
+  test(ident, "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz_0123456789");
+
+  const char* texts[] = {
+    "a b c d e f",
+    "def(extern)deff-externs",
+    "__tmp_reg_000123+__tmp_reg_000124*__tmp_reg_000125",
+    "x@y[z`w{v:u/t",
+    "a_very_long_generated_identifier_that_spans_more_than_sixty_four_bytes_0123456789 zz",
+  };
+  for (const char* text : texts) {
+    CAPTURE(text);
+    const auto expected = lex_all(scan::isa::scalar, text);
+    for (auto level : {scan::isa::sse2, scan::isa::avx2, scan::isa::avx512}) {
+      CAPTURE(scan::isa_name(level));
+      CHECK(lex_all(level, text) == expected);
+    }
+  }
+}
+
+TEST_CASE("keyword table") {
+  for (const auto& keyword : keywords::list) {
+    CHECK(keywords::get_token(keyword.name.data(), keyword.name.size()) == keyword.kind);
+  }
+  for (std::string_view word : {"d", "de", "DEF", "deF", "dex", "xdef", "exter", "externs"}) {
+    CAPTURE(word);
+    CHECK(keywords::get_token(std::string(word).c_str(), word.size()) == ident);
+  }
+
+  // A longer list, such as one with the keywords that are planned, must still be collision free.
+  constexpr std::array<keywords::entry, 10> planned = {{
+    {"def", keyword_def}, {"extern", keyword_def}, {"if", keyword_def}, {"then", keyword_def},
+    {"else", keyword_def}, {"for", keyword_def}, {"in", keyword_def}, {"var", keyword_def},
+    {"binary", keyword_def}, {"unary", keyword_def},
+  }};
+  constexpr keywords::table<planned.size()> lookup(planned);
+  static_assert(lookup.collision_free);
+  for (const auto& keyword : planned) {
+    std::string word(keyword.name);
+    CHECK(lookup.find(word.c_str(), word.size()) == keyword_def);
+    word.back() = '_';
+    CHECK(lookup.find(word.c_str(), word.size()) == ident);
+  }
+  CHECK(lookup.find("i", 1) == ident);
+
+  // A one byte word is found whatever byte follows it.
+  constexpr std::array<keywords::entry, 3> short_words = {{
+    {"x", keyword_def}, {"def", keyword_def}, {"xy", keyword_extern},
+  }};
+  constexpr keywords::table<short_words.size()> short_lookup(short_words);
+  static_assert(short_lookup.collision_free);
+  for (const char* text : {"x", "x+", "xy", "x(", "x y"}) {
+    CAPTURE(text);
+    CHECK(short_lookup.find(text, 1) == keyword_def);
+  }
+  CHECK(short_lookup.find("xy", 2) == keyword_extern);
+  CHECK(short_lookup.find("y+", 1) == ident);
 }
 
 TEST_CASE("decimal int literals") {
@@ -565,6 +522,8 @@ TEST_CASE("binary int literals") {
   test(int_literal, "0b_01");
   test_err((error_type{.tag = invalid_num_lit, .info = non_bin_digit}), "0b012");
   test(int_literal, "0b_0000_0100");
+  test(int_literal, "0b");
+  test_err((error_type{.tag = invalid_num_lit, .info = non_bin_digit}), "0b1__0");
 }
 
 TEST_CASE("octal int literals") {
@@ -610,11 +569,83 @@ TEST_CASE("hex int literals") {
   test(int_literal, "0x0000_FFFF");
   test(int_literal, "0x_dead_beef");
   test(int_literal, "0x_DEAD_BEEF");
-  test(int_literal, "0xabcdefABCDEF012345689");
+  test(int_literal, "0xabcdefABCDEF0123");
+  test_err((error_type{.tag = invalid_num_lit, .info = int_literal_overflow}),
+           "0xabcdefABCDEF012345689");
   test_err((error_type{.tag = invalid_num_lit, .info = non_hex_digit}), "0xabcdefABCDEFg012");
   test(int_literal, "0x40e9");
 }
 
+TEST_CASE("int literal values") {
+  auto value_of = [](const std::string& text) -> std::optional<uint64_t> {
+    lexer_test_source src(text.c_str());
+    lexer lex(src);
+    const token tok = lex.next_token();
+    if (tok.kind != int_literal || tok.loc.len != text.size()) {
+      return std::nullopt;
+    }
+    return lex.int_value();
+  };
+  CHECK(value_of("0") == 0);
+  CHECK(value_of("0b") == 0);
+  CHECK(value_of("1_000_000") == 1000000);
+  CHECK(value_of("0x_dead_BEEF") == 0xdeadbeef);
+  CHECK(value_of("0o755") == 0755);
+  CHECK(value_of("0b1010_1010") == 0xaa);
+  CHECK(value_of("18446744073709551615") == UINT64_MAX);
+  CHECK(value_of("0000000000000000000000018446744073709551615") == UINT64_MAX);
+  CHECK(value_of("1_8_4_4_6_7_4_4_0_7_3_7_0_9_5_5_1_6_1_5") == UINT64_MAX);
+  CHECK(value_of("0xFFFF_FFFF_FFFF_FFFF") == UINT64_MAX);
+  CHECK(value_of("0o1777777777777777777777") == UINT64_MAX);
+  CHECK(value_of("0b" + std::string(64, '1')) == UINT64_MAX);
+  test_err((error_type{.tag = invalid_num_lit, .info = int_literal_overflow}),
+           "18446744073709551616");
+  test_err((error_type{.tag = invalid_num_lit, .info = int_literal_overflow}),
+           "99999999999999999999");
+  test_err((error_type{.tag = invalid_num_lit, .info = int_literal_overflow}),
+           "100000000000000000000");
+  test_err((error_type{.tag = invalid_num_lit, .info = int_literal_overflow}),
+           "0x1_0000_0000_0000_0000");
+  test_err((error_type{.tag = invalid_num_lit, .info = int_literal_overflow}),
+           "0o2000000000000000000000");
+  test_err((error_type{.tag = invalid_num_lit, .info = int_literal_overflow}),
+           ("0b1" + std::string(64, '0')).c_str());
+  // A separator after as many digits as a value can have, and then one digit more.
+  CHECK(value_of("0b" + std::string(63, '1') + "_1") == UINT64_MAX);
+  CHECK(value_of("0o1" + std::string(20, '7') + "_7") == UINT64_MAX);
+  CHECK(value_of("0x" + std::string(15, 'F') + "_F") == UINT64_MAX);
+  test_err((error_type{.tag = invalid_num_lit, .info = int_literal_overflow}),
+           ("0b" + std::string(64, '1') + "_1").c_str());
+  test_err((error_type{.tag = invalid_num_lit, .info = int_literal_overflow}),
+           ("0o" + std::string(22, '7') + "_7").c_str());
+  test_err((error_type{.tag = invalid_num_lit, .info = int_literal_overflow}),
+           ("0x" + std::string(16, 'F') + "_F").c_str());
+
+  // Random values in every radix, with random separators.
+  std::mt19937_64 rng(7);
+  for (int i = 0; i < 20000; i++) {
+    const uint64_t value = rng() >> (rng() % 64);
+    std::string digits;
+    std::string prefix;
+    switch (i % 4) {
+      case 0: digits = fmt::format("{}", value); break;
+      case 1: digits = fmt::format("{:b}", value); prefix = "0b"; break;
+      case 2: digits = fmt::format("{:o}", value); prefix = "0o"; break;
+      default: digits = fmt::format("{:x}", value); prefix = i % 8 == 3 ? "0x" : "0X"; break;
+    }
+    digits.insert(0, rng() % 3, '0');
+    std::string text = prefix;
+    for (size_t j = 0; j < digits.size(); j++) {
+      if (j > 0 && rng() % 5 == 0) {
+        text += '_';
+      }
+      text += digits[j];
+    }
+    CAPTURE(text);
+    CHECK(value_of(text) == value);
+  }
+}
+
 TEST_CASE("decimal float literals") {
   test(float_literal, "0.0");
   test(float_literal, "1.25");
@@ -633,6 +664,11 @@ TEST_CASE("decimal float literals") {
   test(float_literal, "40.20e+9");
   test(float_literal, "40.20e-9");
   test(float_literal, "100_024.2_0E021");
+  test(float_literal, "40e+");
+  test(float_literal, "1e+_5");
+  test_err((error_type{.tag = invalid_num_lit, .info = multiple_radix_points}), "1e1.5");
+  test_err((error_type{.tag = invalid_num_lit, .info = unknown_radix_prefix}), "0e5");
+  test_err((error_type{.tag = invalid_num_lit, .info = non_dec_digit}), "1.5p3");
 }
 
 TEST_CASE("hex float literals") {
@@ -651,5 +687,115 @@ TEST_CASE("hex float literals") {
   test_err((error_type{.tag = invalid_num_lit, .info = missing_fraction_part}), "0xffaa._2139432");
 }
 
+TEST_CASE("incremental relexing") {
+  auto lex_all = [](lexer_test_source& src) {
+    std::pair<std::vector<token::type>, std::vector<module::span>> out;
+    lexer lex(src);
+    token tok;
+    do {
+      tok = lex.next_token();
+      out.first.push_back(tok.kind);
+      out.second.push_back(tok.loc);
+    } while (tok.kind != token::type::eof);
+    return out;
+  };
+
+  // Edits that split, join, and retype tokens, and that open and close comments and lines.
+  const char* snippets[] = {
+    "", " ", "\n", "//", "/", "a", "_b2", "1", "0x", ".", "5", "e", "+", "-", "(", ")", "$", "def",
+    "0b102", "0x_", "1.2.3",
+  };
+  // Errors that are reported again come after those that are kept, so errors are compared in
+  // order of location and then of kind.
+  auto sorted_errors = [](const lexer_test_source& src) {
+    auto errors = src.errors;
+    (std::sort
+      (errors.begin(), errors.end(),
+       [](const auto& lhs, const auto& rhs) {
+         return std::pair(lhs.second.lo, lhs.first.tag) < std::pair(rhs.second.lo, rhs.first.tag);
+       }));
+    return errors;
+  };
+  std::mt19937 rng(7);
+  lexer_test_source src(
+    "alpha + 0x1.8p3 * (beta - 12_34) // note\n\n  def extern 0b12 gamma\n1.5e9 $ 0x_");
+  src.line_offsets.size(); // The table is patched only once it has been built.
+  auto [tokens, token_locs] = lex_all(src);
+  for (int i = 0; i < 2000; i++) {
+    const uint32_t size = src.size();
+    const uint32_t lo = rng() % (size + 1);
+    const uint32_t len = std::min<uint32_t>(rng() % 3, size - lo);
+    const char* text = snippets[rng() % std::size(snippets)];
+    const module::text_edit edit{lo, len, text};
+    CAPTURE(src.contents);
+    CAPTURE(lo);
+    CAPTURE(len);
+    CAPTURE(text);
+    relex(src, edit, tokens, token_locs);
+
+    lexer_test_source fresh(src.contents.c_str());
+    const auto [expected_tokens, expected_locs] = lex_all(fresh);
+    REQUIRE(tokens == expected_tokens);
+    REQUIRE(token_locs == expected_locs);
+    // The errors of the tokens that were not re-lexed are kept, and moved with them.
+    REQUIRE(sorted_errors(src) == sorted_errors(fresh));
+    REQUIRE(std::equal(src.line_offsets.begin(), src.line_offsets.end(),
+                       fresh.line_offsets.begin(), fresh.line_offsets.end()));
+  }
+}
+
+TEST_CASE("incremental relexing is local") {
+  std::string text;
+  for (int i = 0; i < 10000; i++) {
+    text += "value + 0x1.8p3 * (other - 12_34) // comment\n";
+  }
+  lexer_test_source src(text.c_str());
+  std::vector<token::type> tokens;
+  std::vector<module::span> token_locs;
+  lexer lex(src);
+  token tok;
+  do {
+    tok = lex.next_token();
+    tokens.push_back(tok.kind);
+    token_locs.push_back(tok.loc);
+  } while (tok.kind != token::type::eof);
+
+  const uint32_t middle = text.size() / 2 + 2; // Inside of `value`.
+  CHECK(relex(src, {middle, 0, "x"}, tokens, token_locs) == 1);
+  CHECK(relex(src, {middle, 1, ""}, tokens, token_locs) == 1);
+  CHECK(relex(src, {middle, 0, " "}, tokens, token_locs) == 2);
+  CHECK(src.contents.substr(middle - 2, 7) == "va lue ");
+}
+
+TEST_CASE("incremental relexing keeps later errors") {
+  lexer_test_source src("a + b + 0b102 + c + 0x_");
+  std::vector<token::type> tokens;
+  std::vector<module::span> token_locs;
+  lexer lex(src);
+  token tok;
+  do {
+    tok = lex.next_token();
+    tokens.push_back(tok.kind);
+    token_locs.push_back(tok.loc);
+  } while (tok.kind != token::type::eof);
+  const auto old_errors = src.errors;
+  REQUIRE(old_errors.size() == 2);
+
+  // An edit before both invalid literals moves their errors with them.
+  relex(src, {0, 1, "zz"}, tokens, token_locs);
+  REQUIRE(src.errors.size() == 2);
+  CHECK(src.errors[0].first == old_errors[0].first);
+  CHECK(src.errors[0].second.lo == old_errors[0].second.lo + 1);
+  CHECK(src.errors[1].second.lo == old_errors[1].second.lo + 1);
+  CHECK(src.has_error());
+
+  // Fixing one literal drops its error and keeps the other.
+  const uint32_t digit = src.contents.find("102") + 2;
+  relex(src, {digit, 1, "1"}, tokens, token_locs);
+  REQUIRE(src.errors.size() == 1);
+  CHECK(src.errors[0].first == old_errors[1].first);
+  CHECK(src.errors[0].second.lo == old_errors[1].second.lo + 1);
+}
+
 TEST_SUITE_END();
 #endif
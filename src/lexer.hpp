@@ -2,6 +2,7 @@
 #define LEXER_H
 #include "error.hpp"
 #include "module.hpp"
+#include "num_lit_dfa.hpp"
 #include "token.hpp"
 #include <concepts>
 #include <string>
@@ -17,37 +18,60 @@ concept reports_errors = requires(T t, error_type kind, const module::span& loc,
 
 // A lexable source requires:
 // - an `error` reporting method
-// - a vector storing pointers to the start of each line in the source
+// - a table of the start of each line in the source, which the lexer itself never touches
 // - a method that returns a pointer to the start of its contents
 //   -- implicit requirement that contents must have two terminating null bytes
 // - a method that indicates the presence of errors
 template <typename T>
 concept lexable = reports_errors<T> && requires(T t, const T& const_t) {
-  requires std::same_as<decltype(T::line_offsets), std::vector<const char*>>;
+  requires std::same_as<decltype(T::line_offsets), module::line_table>;
   { const_t.start() } -> std::same_as<const char*>;
   { const_t.has_error() } -> std::same_as<bool>;
 };
 
 
+// A lexable source whose text can be edited in place. An edit moves the errors after it, as
+// `module::span_after_edit` moves spans, and the errors of one phase in a range of the source can
+// then be discarded once that phase has reported them again.
+template <typename T>
+concept editable =
+  lexable<T>
+  && requires(T t, const T& const_t, const module::text_edit& edit, const module::span& range) {
+    { t.apply_edit(edit) } -> std::same_as<void>;
+    { const_t.num_errors() } -> std::same_as<size_t>;
+    { t.discard_errors(error_phase::lexing, range, size_t(0)) } -> std::same_as<void>;
+  };
+
+
 template <lexable T> class lexer {
 public:
-  lexer(T &source)
+  // Lexing may begin at any token boundary of the source, not only at its start.
+  lexer(T &source, uint32_t offset = 0)
     : source(source),
-      line_offsets(source.line_offsets),
-      start(source.start()),
+      source_start(source.start()),
+      start(source_start + offset),
       current(start) {}
 
   token next_token();
+  // The hash of the last identifier or keyword that was lexed. See `interner::hash`.
+  uint32_t ident_hash() const { return last_ident_hash; }
+  // The value of the last integer or float literal that was lexed.
+  uint64_t int_value() const { return last_int_value; }
+  double float_value() const { return last_float_value; }
 
 private:
   T& source;
-  std::vector<const char*> &line_offsets;
+  const char* const source_start;
   const char* start;
   const char* current;
+  uint32_t last_ident_hash = 0;
+  uint64_t last_int_value = 0;
+  double last_float_value = 0;
 
   char peek() const;
   char peek_next() const;
   char next();
+  module::span make_span(const char* lo, const char* hi) const;
   token make_token(token::type kind) const;
   void mark_error(error_type kind);
 
@@ -56,32 +80,42 @@ private:
   token seen_keyword_char();
 
   void consume_invalid_num_lit(error_type::detail);
-  token::type scan_dec_digits();
-  token::type seen_dec_point();
-  token::type seen_exponent_char();
-  token::type seen_dec_digit();
-  token::type seen_bin_lit_prefix();
-  token::type seen_oct_lit_prefix();
-  token::type seen_hex_point();
-  token::type seen_hex_lit_prefix();
-  token::type seen_zero();
+  token::type scan_num_lit(num_lit::state state);
 };
 
 
+// Apply `edit` to `source` and patch `tokens` and `token_locs`, which hold every token of `source`
+// from before the edit. Only the tokens from the last token boundary before the edit up to where
+// the new tokens line up with the old ones again are re-lexed; the rest are shifted. The errors of
+// the re-lexed bytes are reported again in place of the old ones, and the errors after them are
+// kept. Returns the number of tokens that were re-lexed.
+template <editable T>
+uint32_t relex
+  (T& source,
+   const module::text_edit& edit,
+   std::vector<token::type>& tokens,
+   std::vector<module::span>& token_locs);
+
+
 #if !defined(DOCTEST_CONFIG_DISABLE)
-// Satisfies `lexable` concept and tracks errors for testing the lexer's error handling.
+// Satisfies `editable` concept and tracks errors for testing the lexer's error handling.
 struct lexer_test_source {
   std::string contents;
-  std::vector<const char*> line_offsets;
-  std::optional<error_type> err_reason;
+  module::line_table line_offsets;
+  std::optional<error_type> err_reason; // The last error reported.
+  std::vector<std::pair<error_type, module::span>> errors; // In the order they were reported.
 
   lexer_test_source(const char* buf);
 
   const char* start() const;
+  size_t size() const;
   bool has_error() const;
   void mark_error(error_type kind, const module::span& loc);
+  void apply_edit(const module::text_edit& edit);
+  size_t num_errors() const;
+  void discard_errors(error_phase phase, const module::span& range, size_t num_old);
 };
-static_assert(lexable<lexer_test_source>);
+static_assert(editable<lexer_test_source>);
 #endif
 
 #endif
@@ -2,10 +2,15 @@
 #include "doctest.hpp"
 #include "module.hpp"
 #include "ast.hpp"
+#include "ast_cache.hpp"
 #include "ast_pretty_printer.hpp"
 #include "parser.hpp"
 #include "error.hpp"
+#include "stream.hpp"
+#include "token_dump.hpp"
 
+#include <optional>
+#include <thread>
 #include <fmt/core.h>
 
 
@@ -22,14 +27,91 @@ int main(int argc, char **argv) {
   }
 #endif
 
-  module::file file(argv[1]);
-  parsing::parser parser(file);
-  parser.parse();
+  // Inputs of any size, including standard input as "-", can be lexed through a bounded window
+  // without being parsed.
+  if (argc > 2 && std::string_view(argv[1]) == "--stream") {
+    module::stream source(argv[2]);
+    source.lex([&](const module::stream::batch& batch) {
+      for (size_t i = 0; i < batch.tokens.size(); i++) {
+        token cur(batch.tokens[i], batch.token_locs[i]);
+        module::stream_pos pos = source.position(cur.loc);
+        (fmt::print
+          ("{:<8} {:<13} '{}'\n",
+           fmt::format("{}:{}", pos.line_no, pos.col_no), cur.kind, cur.lexeme(source.start())));
+      }
+    });
+    source.display_errors();
+    return source.has_error() ? EXIT_FAILURE : EXIT_SUCCESS;
+  }
+
+  // `--print-tokens` prints the tokens as text, and `--dump-tokens <path>` writes them to a binary
+  // token file that tools can load without lexing. `--cache <dir>` reuses the tree of a source
+  // whose contents were parsed by an earlier run, and `--cache-stats` reports the cache's counts.
+  // `--rebalance` balances long chains of integer `+` and `*`, and `--rebalance-floats` also those
+  // of floats, which may round differently afterwards.
+  const unsigned num_threads = std::max(1u, std::thread::hardware_concurrency());
+  parsing::options opts = {.lex_threads = num_threads, .parse_threads = num_threads};
+  const char* dump_path = nullptr;
+  const char* cache_dir = nullptr;
+  bool print_cache_stats = false;
+  std::optional<ast::reassociation> rebalance;
+  int arg = 1;
+  for (; arg < argc - 1; arg++) {
+    const std::string_view flag = argv[arg];
+    if (flag == "--print-tokens") {
+      opts.print_tokens = true;
+    } else if (flag == "--dump-tokens" && arg + 2 < argc) {
+      dump_path = argv[++arg];
+    } else if (flag == "--cache" && arg + 2 < argc) {
+      cache_dir = argv[++arg];
+    } else if (flag == "--cache-stats") {
+      print_cache_stats = true;
+    } else if (flag == "--rebalance") {
+      rebalance = ast::reassociation::integers;
+    } else if (flag == "--rebalance-floats") {
+      rebalance = ast::reassociation::integers_and_floats;
+    } else {
+      break;
+    }
+  }
+  if (arg >= argc) {
+    error::simple_error("expected a source file");
+    return EXIT_FAILURE;
+  }
+
+  module::file file(argv[arg]);
+  // Printing tokens needs the lexer, so it bypasses the cache.
+  std::optional<ast_cache::cache> cache;
+  if (cache_dir && !opts.print_tokens) {
+    cache.emplace(cache_dir);
+  }
+  if (!cache || !cache->load(file, opts.symbols)) {
+    parsing::parser parser(file, opts);
+    parser.parse();
+    if (cache && !file.has_error()) {
+      cache->store(file);
+    }
+  }
+  if (cache && print_cache_stats) {
+    const ast_cache::stats totals = cache->totals();
+    (fmt::print
+      (stderr, "cache: {} hits, {} misses, {} stores, {} evictions\n",
+       totals.hits, totals.misses, totals.stores, totals.evictions));
+  }
+  if (dump_path
+      && !token_dump::write(dump_path, file.abs_syntax->tokens, file.abs_syntax->token_locs)) {
+    error::simple_error(fmt::format("unable to write '{}'", dump_path));
+    return EXIT_FAILURE;
+  }
   if (file.has_error()) {
     file.display_errors();
     return EXIT_FAILURE;
   }
 
+  // The cache holds trees as they were parsed, so that it serves runs with and without balancing.
+  if (rebalance) {
+    ast::rebalance(*file.abs_syntax, *rebalance);
+  }
   ast::pretty_printer<> pp(*file.abs_syntax, std::ostream_iterator<char>{std::cerr}, &file);
   pp.traverse_ast();
   return EXIT_SUCCESS;
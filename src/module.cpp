@@ -1,42 +1,152 @@
 #include "module.hpp"
 #include "error.hpp"
-#include "ast.hpp"    // Required for implicit `file` destructor.
+#include "ast.hpp"    // Required for `file` destructor.
+#include "scan.hpp"
+#include "doctest.hpp"
 #include <iostream>
 #include <fstream>
 #include <iterator>
+#include <numeric>
 #include <filesystem>
 #include <fmt/core.h>
 
+#if defined(__unix__) || defined(__APPLE__)
+#define OS_POSIX
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 namespace module {
 
 //------------------------------------------------------------------------------------------------//
-file::file(fs::path name) : name(name), err_handler(*this) {
-  std::ifstream in_stream(name);
+namespace {
+
+[[noreturn]] void file_too_large(const fs::path& name) {
+  (error::simple_error
+    (fmt::format("'{}' is too large: expected a file size less than 4096MB.", name.string())));
+  exit(EXIT_FAILURE);
+}
+
+#if defined(OS_POSIX)
+// Map `size` bytes of `fd` followed by at least one page of zeros, which provides the two null
+// bytes that `lexer<T>` expects after the contents without copying the file. Bytes past the end of
+// the file within its last page also read as zero. Returns `nullptr` if the file cannot be mapped.
+void* map_with_zero_page(int fd, size_t size, size_t& mapping_size) {
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  const size_t file_pages_size = (size + page_size - 1) / page_size * page_size;
+  mapping_size = file_pages_size + page_size;
+  // Reserve the whole range with anonymous zero pages, then map the file over the front of it.
+  void* base = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED) {
+    return nullptr;
+  }
+  if (mmap(base, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+    munmap(base, mapping_size);
+    return nullptr;
+  }
+  madvise(base, size, MADV_SEQUENTIAL);
+  return base;
+}
+
+// Read all of `fd`, which may be a pipe or other special file whose size is unknown. The buffer
+// has room for one byte past `size_hint`, so a regular file is read without growing it and there is
+// space left for the terminating null byte. A failed read is reported rather than taken for the end
+// of the file, which would lex a truncated source.
+std::string read_all(int fd, size_t size_hint, const fs::path& name) {
+  std::string contents(std::max<size_t>(size_hint + 1, 1 << 16), '\0');
+  size_t num_filled = 0;
+  for (;;) {
+    if (num_filled == contents.size()) {
+      contents.resize(2 * contents.size());
+    }
+    const ssize_t num_read = read(fd, contents.data() + num_filled, contents.size() - num_filled);
+    if (num_read < 0 && errno == EINTR) {
+      continue;
+    }
+    if (num_read < 0) {
+      error::simple_error(fmt::format("unable to read '{}'", name.string()));
+      exit(EXIT_FAILURE);
+    }
+    if (num_read == 0) {
+      break;
+    }
+    num_filled += num_read;
+  }
+  contents.resize(num_filled);
+  return contents;
+}
+#endif
+
+} // End unnamed namespace.
+
+file::file(fs::path name, load_mode mode) : name(name), err_handler(*this) {
+#if defined(OS_POSIX)
+  const int fd = open(name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    error::simple_error(fmt::format("unable to open '{}'", name.string()));
+    exit(EXIT_FAILURE);
+  }
+  struct stat info;
+  const bool is_regular = fstat(fd, &info) == 0 && S_ISREG(info.st_mode);
+  const size_t size = is_regular ? info.st_size : 0;
+  if (size > std::numeric_limits<uint32_t>::max()) {
+    file_too_large(name);
+  }
+  if (mode == load_mode::mapped && size > 0) {
+    mapping = map_with_zero_page(fd, size, mapping_size);
+  }
+  if (mapping) {
+    contents = std::string_view(static_cast<const char*>(mapping), size);
+  } else {
+    buffer = read_all(fd, size, name);
+  }
+  close(fd);
+#else
+  std::ifstream in_stream(name, std::ios::binary);
   if (!in_stream) {
     error::simple_error(fmt::format("unable to open '{}'", name.string()));
     exit(EXIT_FAILURE);
   }
+  buffer = std::string(std::istreambuf_iterator<char>{in_stream}, {});
+#endif
 
-  contents = std::string(std::istreambuf_iterator<char>{in_stream}, {});
-  if (contents.size() > std::numeric_limits<uint32_t>::max()) {
-    (error::simple_error
-      (fmt::format("'{}' is too large: expected a file size less than 4096MB.", name.string())));
-    exit(EXIT_FAILURE);
+  if (!mapping) {
+    if (buffer.size() > std::numeric_limits<uint32_t>::max()) {
+      file_too_large(name);
+    }
+    // Append additional null byte so that `lexer<T>::peek_next` will return a null byte on the
+    // last byte. This avoids having to check for EOF every time that `lexer<T>::peek_next` is
+    // called.
+    buffer.push_back('\0');
+    contents = std::string_view(buffer.data(), buffer.size() - 1);
+  }
+  line_offsets = line_table(contents.data(), contents.size());
+}
+
+file::~file() {
+#if defined(OS_POSIX)
+  if (mapping) {
+    munmap(mapping, mapping_size);
   }
+#endif
+}
 
-  // Append additional null byte so that `lexer<T>::peek_next` will return a null byte on the last
-  // byte. This avoids having to check for EOF every time that `lexer<T>::peek_next` is called.
-  contents.push_back('\0');
-  line_offsets.push_back(contents.c_str());
+file::load_mode file::mode() const {
+  return mapping ? load_mode::mapped : load_mode::buffered;
 }
 
 const char* file::start() const { return contents.data(); }
 
+size_t file::size() const { return contents.size(); }
+
 std::string_view file::line(uint32_t line_no, uint32_t num_lines) const {
   uint32_t idx = line_no - 1;
-  const char* beg = line_offsets[idx];
-  const char* end = line_offsets[idx + num_lines];
-  return span(beg, end - 1).contents();
+  const uint32_t beg = line_offsets[idx];
+  const uint32_t end = line_offsets[idx + num_lines];
+  return contents.substr(beg, end - 1 - beg);
 }
 
 uint32_t file::estimate_num_tokens() const {
@@ -56,17 +166,94 @@ void file::mark_error(error_type kind, const span& loc, uint32_t line_no, uint32
 
 void file::display_errors() const { err_handler.display_errors(); }
 
+size_t file::num_errors() const { return err_handler.errors.size(); }
+
+void file::discard_errors(error_phase phase, const span& range, size_t num_old) {
+  auto& errors = err_handler.errors;
+  const auto old_end = errors.begin() + num_old;
+  auto is_stale = [&](const error& err) {
+    const auto is_same = [&](const error& other) {
+      return other.kind == err.kind && other.loc == err.loc;
+    };
+    return phase_of(err.kind) == phase
+           && ((err.loc.lo >= range.lo && err.loc.lo < range.hi())
+               || std::any_of(old_end, errors.end(), is_same));
+  };
+  errors.erase(std::remove_if(errors.begin(), old_end, is_stale), old_end);
+}
+
+void file::apply_edit(const text_edit& edit) {
+  std::erase_if(err_handler.errors, [&](error& err) {
+    const std::optional<span> moved = span_after_edit(err.loc, edit);
+    err.loc = moved.value_or(err.loc);
+    return !moved;
+  });
+  if (contents.size() - edit.len + edit.text.size() > std::numeric_limits<uint32_t>::max()) {
+    file_too_large(name);
+  }
+#if defined(OS_POSIX)
+  if (mapping) {
+    buffer.reserve(contents.size() + edit.text.size() + 1);
+    buffer.assign(contents);
+    buffer.push_back('\0');
+    munmap(mapping, mapping_size);
+    mapping = nullptr;
+  }
+#endif
+  buffer.replace(edit.lo, edit.len, edit.text);
+  contents = std::string_view(buffer.data(), buffer.size() - 1);
+  line_offsets.apply_edit(contents.data(), contents.size(), edit);
+}
+
 //------------------------------------------------------------------------------------------------//
-int span::len() const {
-  return std::distance(lo, hi);
+const std::vector<uint32_t>& line_table::offsets() const {
+  if (!built) {
+    starts.push_back(0);
+    scan::find_line_starts(text, text + text_size, starts);
+    starts.push_back(text_size + 1);
+    built = true;
+  }
+  return starts;
 }
 
-std::string_view span::contents() const {
-  return std::string_view(lo, len());
+void line_table::apply_edit(const char* new_text, size_t new_size, const text_edit& edit) {
+  text = new_text;
+  text_size = new_size;
+  if (!built) {
+    return;
+  }
+  // Lines that start within the replaced bytes are removed and the lines after them are shifted.
+  auto first = std::upper_bound(starts.begin(), starts.end(), edit.lo);
+  auto last = std::upper_bound(first, starts.end(), edit.lo + edit.len);
+  const uint32_t shift = edit.text.size() - edit.len; // Wraps around when text is removed.
+  for (auto iter = last; iter != starts.end(); iter++) {
+    *iter += shift;
+  }
+  std::vector<uint32_t> inserted;
+  scan::find_line_starts(text + edit.lo, text + edit.lo + edit.text.size(), inserted);
+  for (auto& line_start : inserted) {
+    line_start += edit.lo;
+  }
+  starts.insert(starts.erase(first, last), inserted.begin(), inserted.end());
+}
+
+//------------------------------------------------------------------------------------------------//
+std::string_view span::contents(const char* source_start) const {
+  return std::string_view(source_start + lo, len);
 }
 
 bool operator==(const span& lhs, const span& rhs) {
-  return lhs.lo == rhs.lo && lhs.hi == rhs.hi;
+  return lhs.lo == rhs.lo && lhs.len == rhs.len;
+}
+
+std::optional<span> span_after_edit(const span& loc, const text_edit& edit) {
+  if (loc.lo < edit.lo) {
+    return loc;
+  }
+  if (loc.lo < edit.lo + edit.len) {
+    return std::nullopt;
+  }
+  return span(loc.lo + edit.text.size() - edit.len, loc.len);
 }
 
 //------------------------------------------------------------------------------------------------//
@@ -85,7 +272,7 @@ bool error_context::has_error() const {
 }
 
 void error_context::mark_error(error_type kind, const span& loc) {
-  errors.emplace_back(std::move(kind), file_pos(file, loc));
+  errors.emplace_back(std::move(kind), loc);
 }
 
 void error_context::mark_error
@@ -93,22 +280,39 @@ void error_context::mark_error
    const span& loc,
    uint32_t line_no,
    uint32_t num_lines) {
-  errors.emplace_back(std::move(kind), file_pos(file, loc), line_no, num_lines);
+  errors.emplace_back(std::move(kind), loc, line_no, num_lines);
 }
 
+// The parser reports its errors after the lexer has reported those of every token, so the errors
+// are put in order of location and their positions found in one pass before any is displayed.
 void error_context::display_errors() const {
-  for (const auto& err : errors) {
-    display(err);
+  std::vector<uint32_t> order(errors.size());
+  std::iota(order.begin(), order.end(), 0);
+  (std::stable_sort
+    (order.begin(), order.end(),
+     [&](uint32_t lhs, uint32_t rhs) { return errors[lhs].loc.lo < errors[rhs].loc.lo; }));
+  std::vector<file_pos> positions(errors.size());
+  position_cursor cursor(file);
+  for (uint32_t idx : order) {
+    positions[idx] = cursor.find(errors[idx].loc);
+  }
+  for (size_t i = 0; i < errors.size(); i++) {
+    display(errors[i], positions[i]);
     fmt::print(stderr, "\n");
   }
 }
 
+void error_context::display(const error& err) const {
+  display(err, file_pos(file, err.loc));
+}
+
 // TODO: Possibly remove explicit dependency on module::file via a concept. All that is required is a
 // `line` method and a `name` member of type `fs::path`.
-// TODO: Calculate column number in a Unicode friendly way. A column should be defined as either a code point or a
-// grapheme cluster; currently not sure which is the best representation.
-void error_context::display(const error& err) const {
-  uint32_t line_after_err = err.line_no + err.num_lines;
+// TODO: Columns are code points, which is wrong for wide characters and combining marks. Grapheme
+// clusters and their display widths would be needed to always line up the caret.
+void error_context::display(const error& err, const file_pos& pos) const {
+  const uint32_t first_line = err.line_no != 0 ? err.line_no : pos.line_no;
+  uint32_t line_after_err = first_line + err.num_lines;
   uint32_t num_line_digits = uint32_t(log10(line_after_err)) /* + 1 */;
   uint32_t line_no_display_width = (num_line_digits <= 3) ? 4 : num_line_digits + 1;
 
@@ -121,7 +325,7 @@ void error_context::display(const error& err) const {
      fmt::format(style.err_label, "error:"),
      fmt::format(style.msg, "{}", err.kind),
      fmt::format(style.arrow, "==>"),
-     fmt::format(style.file_info,"{}:{}", file.name.string(), err.pos),
+     fmt::format(style.file_info,"{}:{}", file.name.string(), pos),
      "", line_no_display_width));
 
   // <line-no> | <source-code-line>
@@ -129,20 +333,229 @@ void error_context::display(const error& err) const {
   //           |  <location-marker>
   // <line-no> | <source-code-line>
   //          ...
-  for (auto i = err.line_no; i < line_after_err; i++) {
+  for (auto i = first_line; i < line_after_err; i++) {
     (fmt::print
       (stderr,
        "{:>{}d} | {}\n",
        i, line_no_display_width,
        file.line(i)));
-    if (i == err.pos.line_no) {
+    if (i == pos.line_no) {
       (fmt::print
         (stderr,
          "{:<{}} | {}\n",
          "", line_no_display_width,
-         fmt::format(style.caret, "{:>{}}", std::string(err.pos.len, '^'), err.pos.col_no)));
+         fmt::format(style.caret, "{:>{}}", std::string(pos.len, '^'), pos.col_no)));
     }
   }
 }
 
+
+//------------------------------------------------------------------------------------------------//
+#if !defined(DOCTEST_CONFIG_DISABLE)
+TEST_SUITE_BEGIN("modules");
+
+TEST_CASE("load modes") {
+  // A file that fills its last page exactly relies on the extra zero page for its null bytes.
+  for (size_t size : {size_t(1), size_t(4095), size_t(4096), size_t(3 * 4096)}) {
+    CAPTURE(size);
+    const std::string text(size, 'x');
+    const fs::path path = fs::temp_directory_path() / "kal-test-load-modes.kal";
+    std::ofstream(path, std::ios::binary) << text;
+    for (auto mode : {file::load_mode::mapped, file::load_mode::buffered}) {
+      file source(path, mode);
+      CHECK(source.mode() == mode);
+      CHECK(std::string_view(source.start(), size) == text);
+      CHECK(source.start()[size] == '\0');
+      CHECK(source.start()[size + 1] == '\0');
+    }
+    fs::remove(path);
+  }
+}
+
+TEST_CASE("line table") {
+  std::string text;
+  for (int i = 0; i < 100; i++) {
+    text += std::string(i % 37, 'x') + (i % 5 == 0 ? "\n\n" : "\n");
+  }
+  text += "last";
+  std::vector<std::ptrdiff_t> expected{0};
+  for (size_t i = 0; i < text.size(); i++) {
+    if (text[i] == '\n') {
+      expected.push_back(i + 1);
+    }
+  }
+  expected.push_back(text.size() + 1);
+  text.push_back('\0');
+
+  for (auto level : {scan::isa::scalar, scan::isa::sse2, scan::isa::avx2, scan::isa::avx512}) {
+    CAPTURE(scan::isa_name(level));
+    scan::use_isa(level);
+    // Start at every alignment so that the first and last vector blocks are partially in range.
+    for (size_t skip = 0; skip < 64; skip++) {
+      CAPTURE(skip);
+      const char* start = text.data() + skip;
+      struct { line_table line_offsets; } source{line_table(start, text.size() - 1 - skip)};
+      CHECK(!source.line_offsets.is_built());
+      std::vector<std::ptrdiff_t> offsets;
+      for (uint32_t line : source.line_offsets) {
+        offsets.push_back(skip + line);
+      }
+      CHECK(source.line_offsets.is_built());
+      std::vector<std::ptrdiff_t> expected_from_skip{std::ptrdiff_t(skip)};
+      for (auto offset : expected) {
+        if (offset > std::ptrdiff_t(skip)) {
+          expected_from_skip.push_back(offset);
+        }
+      }
+      CHECK(offsets == expected_from_skip);
+    }
+  }
+  scan::use_isa(scan::detected_isa());
+}
+
+TEST_CASE("positions & lines") {
+  const fs::path path = fs::temp_directory_path() / "kal-test-positions.kal";
+  std::ofstream(path, std::ios::binary) << "a\nbc\n\n  d";
+  file source(path);
+  CHECK(!source.line_offsets.is_built());
+
+  // A token at the start of a line belongs to that line rather than to the one before it.
+  file_pos first(source, span(0, 1));
+  CHECK(first.line_no == 1);
+  CHECK(first.col_no == 1);
+  file_pos second(source, span(2, 2));
+  CHECK(second.line_no == 2);
+  CHECK(second.col_no == 1);
+  CHECK(second.len == 2);
+  file_pos last(source, span(8, 1));
+  CHECK(last.line_no == 4);
+  CHECK(last.col_no == 3);
+  file_pos eof(source, span(9, 1));
+  CHECK(eof.line_no == 4);
+  CHECK(eof.col_no == 4);
+
+  CHECK(source.line(1) == "a");
+  CHECK(source.line(2) == "bc");
+  CHECK(source.line(3) == "");
+  CHECK(source.line(4) == "  d");
+  CHECK(source.line(2, 2) == "bc\n");
+  fs::remove(path);
+}
+
+TEST_CASE("batch positions") {
+  // Multibyte characters of every length, including one that a vector block splits.
+  std::string text;
+  for (int i = 0; i < 300; i++) {
+    text += std::string(i % 23, ' ') + "x\u00e9y \u2192 z\U0001d54f" + std::string(i % 70, 'w');
+    text += (i % 40 == 0) ? std::string(20, '\n') : "\n";
+  }
+  const fs::path path = fs::temp_directory_path() / "kal-test-batch-positions.kal";
+  std::ofstream(path, std::ios::binary) << text;
+  file source(path);
+
+  // Lines and columns counted one byte at a time.
+  std::vector<span> locs;
+  std::vector<file_pos> expected;
+  uint32_t line_no = 1, col_no = 1;
+  for (uint32_t lo = 0; lo < text.size(); lo++) {
+    const bool is_continuation = (uint8_t(text[lo]) & 0xC0) == 0x80;
+    if (!is_continuation && lo % 3 != 0) {
+      const uint32_t len = std::min<uint32_t>(5, text.size() - lo);
+      uint32_t num_code_points = 0;
+      for (uint32_t i = lo; i < lo + len; i++) {
+        num_code_points += (uint8_t(text[i]) & 0xC0) != 0x80;
+      }
+      locs.emplace_back(lo, len);
+      expected.emplace_back(line_no, col_no, num_code_points);
+    }
+    if (text[lo] == '\n') {
+      line_no += 1;
+      col_no = 1;
+    } else if (!is_continuation) {
+      col_no += 1;
+    }
+  }
+
+  for (auto level : {scan::isa::scalar, scan::isa::sse2, scan::isa::avx2, scan::isa::avx512}) {
+    CAPTURE(scan::isa_name(level));
+    scan::use_isa(level);
+    for (size_t skip = 0; skip < 64; skip++) {
+      const char* lo = text.data() + skip;
+      const uint32_t count = std::count_if(lo, lo + 100, [](char c) { return (c & 0xC0) != 0x80; });
+      CHECK(scan::count_code_points(lo, lo + 100) == count);
+    }
+
+    // Every span, and spans far enough apart that the lines between them are searched.
+    for (size_t stride : {size_t(1), size_t(97)}) {
+      CAPTURE(stride);
+      std::vector<span> some_locs;
+      std::vector<file_pos> some_expected;
+      for (size_t i = 0; i < locs.size(); i += stride) {
+        some_locs.push_back(locs[i]);
+        some_expected.push_back(expected[i]);
+      }
+      std::vector<file_pos> found;
+      positions(source, some_locs, found);
+      REQUIRE(found.size() == some_expected.size());
+      for (size_t i = 0; i < found.size(); i++) {
+        CAPTURE(some_locs[i].lo);
+        CHECK(found[i].line_no == some_expected[i].line_no);
+        CHECK(found[i].col_no == some_expected[i].col_no);
+        CHECK(found[i].len == some_expected[i].len);
+        const file_pos single(source, some_locs[i]);
+        CHECK(single.line_no == found[i].line_no);
+        CHECK(single.col_no == found[i].col_no);
+      }
+    }
+  }
+  scan::use_isa(scan::detected_isa());
+  fs::remove(path);
+}
+
+TEST_CASE("edits") {
+  const fs::path path = fs::temp_directory_path() / "kal-test-edits.kal";
+  std::ofstream(path, std::ios::binary) << "a\nbc\n\n  d";
+  file source(path, file::load_mode::mapped);
+  source.line_offsets.size();
+
+  source.apply_edit({3, 1, "x\ny"});
+  CHECK(source.mode() == file::load_mode::buffered);
+  CHECK(std::string_view(source.start(), source.size()) == "a\nbx\ny\n\n  d");
+  CHECK(source.start()[source.size() + 1] == '\0');
+  CHECK(source.line(2) == "bx");
+  CHECK(source.line(3) == "y");
+  CHECK(source.line(5) == "  d");
+
+  source.apply_edit({1, 6, ""});
+  CHECK(std::string_view(source.start(), source.size()) == "a\n  d");
+  CHECK(source.line_offsets.size() == 3);
+  CHECK(source.line(2) == "  d");
+
+  // Errors after an edit move with the text, and those within the replaced bytes are discarded.
+  const error_type bad_char = {.tag = error_type::unknown_char, .ch = '$'};
+  const error_type missing_paren = {.tag = error_type::expected_token, .token = token::type::right_paren};
+  source.mark_error(bad_char, {0, 1});
+  source.mark_error(bad_char, {3, 1});
+  source.mark_error(missing_paren, {4, 1});
+  source.apply_edit({1, 1, "  "});
+  CHECK(source.num_errors() == 3);
+  source.apply_edit({0, 1, "b"});
+  CHECK(source.num_errors() == 2);
+  CHECK(source.has_error());
+
+  // Only the old errors of one phase are discarded, and only within the range or when they have
+  // been reported again.
+  source.mark_error(bad_char, {4, 1});
+  source.discard_errors(error_phase::lexing, {5, 1}, 2); // The old error at 4 was reported again.
+  CHECK(source.num_errors() == 2);
+  source.discard_errors(error_phase::lexing, {0, 0}, 2);
+  CHECK(source.num_errors() == 2);
+  source.discard_errors(error_phase::parsing, {0, 6}, 2);
+  CHECK(source.num_errors() == 1);
+  fs::remove(path);
+}
+
+TEST_SUITE_END();
+#endif
+
 } // End `module` namespace.
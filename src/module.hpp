@@ -1,5 +1,10 @@
 #ifndef MODULE_H
 #define MODULE_H
+#include "scan.hpp"
+
+#include <algorithm>
+#include <optional>
+#include <span>
 #include <vector>
 #include <string>
 #include <filesystem>
@@ -12,6 +17,7 @@ namespace fs = std::filesystem;
 // Declared in error.hpp.
 struct error_type;
 struct error;
+enum class error_phase : uint8_t;
 
 // Declared in ast.hpp.
 namespace ast {
@@ -22,6 +28,47 @@ namespace module {
 
 struct span;
 struct file;
+struct file_pos;
+
+
+// An edit that replaces the `len` bytes at offset `lo` of a source with `text`.
+struct text_edit {
+  uint32_t lo;
+  uint32_t len;
+  std::string_view text;
+};
+
+
+// The offset of every character that begins a line of a source, followed by the offset one past
+// its first terminating null byte. The final entry means that every line, including the last, ends
+// one byte before the start of the next entry.
+//
+// The lexer does not record lines. Instead, the table is built with a single vectorized scan for
+// newlines the first time that it is used, so a source that never needs a position never pays for
+// one.
+class line_table {
+public:
+  line_table() = default;
+  line_table(const char* text, size_t size) : text(text), text_size(size) {}
+
+  uint32_t operator[](size_t idx) const { return offsets()[idx]; }
+  size_t size() const { return offsets().size(); }
+  auto begin() const { return offsets().begin(); }
+  auto end() const { return offsets().end(); }
+  bool is_built() const { return built; }
+
+  // Patch the table for `edit`, which has already been applied to the source. The source now
+  // starts at `text` and is `size` bytes long. Only the lines of the replacement text are scanned.
+  void apply_edit(const char* text, size_t size, const text_edit& edit);
+
+private:
+  const char* text = nullptr;
+  size_t text_size = 0;
+  mutable std::vector<uint32_t> starts;
+  mutable bool built = false;
+
+  const std::vector<uint32_t>& offsets() const;
+};
 
 // TODO: If/when multiple source files are supported, all of them can have the same display context.
 // Right now every file has a unique error handler, so some way to avoid creating a new display
@@ -46,18 +93,32 @@ struct error_context {
   void mark_error(error_type kind, const span& loc, uint32_t line_no, uint32_t num_lines);
   void display_errors() const;
   void display(const error& err) const;
+  void display(const error& err, const file_pos& pos) const;
 };
 
 
 // Satisfies `parseable` concept.
 struct file {
+  // How the contents of a file are brought into memory. A mapped file is never copied; pipes and
+  // other special files that cannot be mapped are always buffered.
+  enum class load_mode : uint8_t {
+    mapped,
+    buffered,
+  };
+
   fs::path name;
-  std::vector<const char*> line_offsets; // The address of every character that begins a new line.
+  line_table line_offsets;
   std::unique_ptr<ast::tree> abs_syntax;
 
-  file(fs::path name);
+  file(fs::path name, load_mode mode = load_mode::mapped);
+  ~file();
+
+  file(const file&) = delete;
+  file& operator=(const file&) = delete;
 
+  load_mode mode() const;
   const char* start() const;
+  size_t size() const;
   std::string_view line(uint32_t line_no, uint32_t num_lines = 1) const;
   uint32_t estimate_num_tokens() const;
 
@@ -66,73 +127,131 @@ struct file {
   void mark_error(error_type kind, const span& loc, uint32_t line_no, uint32_t num_lines);
   void display_errors() const;
 
+  // Replace a range of the contents. A mapped file is copied into a buffer on its first edit.
+  // Errors within the replaced bytes are discarded and those after them move with the text that
+  // follows them, as `span_after_edit` moves spans.
+  void apply_edit(const text_edit& edit);
+  // The number of errors reported so far, and the removal of the errors of `phase`, among the
+  // first `num_old` reported, that start within `range` or that were reported again since. This
+  // is how `relex` and `reparse` replace the old errors of the part of the source that they go
+  // over again; an error can lie one byte past the token that reports it, so an old error at the
+  // end of that part is only known to be stale once it has been reported again.
+  size_t num_errors() const;
+  void discard_errors(error_phase phase, const span& range, size_t num_old);
+
 private:
-  std::string contents;
+  std::string buffer;        // Holds the contents of a buffered file.
+  std::string_view contents; // Excludes the two terminating null bytes.
+  void* mapping = nullptr;   // The address and size of a mapped file, including its zero page.
+  size_t mapping_size = 0;
   error_context err_handler;
 };
 
 
-// TODO: Replace `span` and `file_pos` with:
-// struct span {
-//   const char* start;
-//   uint32_t line_no;
-//   uint16_t col_no;
-//   uint16_t len;
-// }
-// It is the same size as current `span` yet contains the information of both. Alternatively,
-// uint32_t indices could be used for lo & hi resultig in 8 byte size instead of 16.
-
-// The address bounds [lo, hi) of a contiguous sequence of characters in a source file.
+// The bounds [lo, lo + len) of a contiguous sequence of characters in a source, as offsets from
+// the start of the source. A source is at most 4GiB, so a span is half the size of a pair of
+// addresses; one is stored for every token.
 struct span {
-  const char* lo;
-  const char* hi;
+  uint32_t lo;
+  uint32_t len;
 
   span() = default;
-  span(const char* lo, const char* hi) : lo(lo), hi(hi) {}
+  span(uint32_t lo, uint32_t len) : lo(lo), len(len) {}
 
-  int len() const;
-  std::string_view contents() const;
+  uint32_t hi() const { return lo + len; }
+  std::string_view contents(const char* source_start) const;
 };
+static_assert(sizeof(span) == 8);
 
 bool operator==(const span& lhs, const span& rhs);
 
+// Where `loc`, a span of a source before `edit`, is once the edit is made. A span that starts past
+// the replaced bytes moves with the text that follows them and one that starts before them stays,
+// while one that starts within them is gone.
+std::optional<span> span_after_edit(const span& loc, const text_edit& edit);
 
+
+// A line and column of a source, both counted from 1. Columns and lengths are counted in UTF-8
+// code points rather than bytes, so that a caret under a line lines up with what a terminal shows
+// for text without wide characters.
 struct file_pos {
   uint32_t line_no;
   uint16_t col_no;
   uint16_t len;
 
+  file_pos() = default;
   // Requires a type that satisfies `lexable` concept.
   file_pos(const auto& source, const span& loc);
   file_pos(uint32_t line_no, uint32_t col_no, uint32_t len)
     : line_no(line_no), col_no(col_no), len(len) {}
 };
 
-inline file_pos::file_pos(const auto& source, const span& loc) {
-  uint32_t line_start_idx;
-  // fmt::print("line_offsets: {}\n", file.line_offsets);
-  auto iter = std::lower_bound(source.line_offsets.begin(), source.line_offsets.end(), loc.lo);
-  if (iter != source.line_offsets.begin()) {
-    // `std::lower_bound` returns an iterator pointing to the start of the first line that is not
-    // less than `loc.lo`. We want the start of the first line that is not greater than `loc.lo`.
-    iter -= 1;
+
+// Finds the positions of spans given in order of their starts, which is the order of the tokens of
+// a source, by merging them with its line table. The line and column of the previous span are kept,
+// so a span on the same line only counts the code points since the previous one, and a span on a
+// later line steps over the lines in between rather than searching the whole table.
+//
+// Requires a type that satisfies `lexable` concept.
+template <typename T> class position_cursor {
+public:
+  position_cursor(const T& source)
+    : text(source.start()),
+      lines_begin(source.line_offsets.begin()),
+      lines_end(source.line_offsets.end()),
+      line(lines_begin) {}
+
+  // `loc` must not start before the span given to the previous call.
+  file_pos find(const span& loc);
+
+private:
+  // Lines that are more than this many lines ahead are found with a binary search.
+  static constexpr int max_steps = 8;
+
+  const char* text;
+  std::vector<uint32_t>::const_iterator lines_begin;
+  std::vector<uint32_t>::const_iterator lines_end;
+  std::vector<uint32_t>::const_iterator line; // The start of the line of the previous span.
+  uint32_t col_lo = 0; // The offset of the previous span, or of the start of its line.
+  uint32_t col_no = 1; // The column of `col_lo`.
+};
+
+template <typename T> file_pos position_cursor<T>::find(const span& loc) {
+  if (line[1] <= loc.lo) {
+    line += 1;
+    for (int steps = 0; line[1] <= loc.lo; steps++, line++) {
+      if (steps == max_steps) {
+        // The line that contains `loc.lo` is the last one that starts at or before it.
+        line = std::upper_bound(line, lines_end, loc.lo) - 1;
+        break;
+      }
+    }
+    col_lo = *line;
+    col_no = 1;
   }
-  // if (iter == file.line_offsets.end()) {
-  //   // The span is on the line that is currently being processed (or the last line of the file).
-  //   fmt::print("here?\n");
-  //   line_start_idx = file.line_offsets.size() - 1;
-  // } else {
-  //   line_start_idx = std::distance(file.line_offsets.begin(), iter);
-  // }
-  line_start_idx = std::distance(source.line_offsets.begin(), iter);
-  // fmt::print("`line_start_idx`: {}\n", line_start_idx);
-  const char* line_start = source.line_offsets[line_start_idx];
-  // fmt::print("`line_start`:{} `loc.lo`:{}\n", fmt::ptr(line_start), fmt::ptr(loc.lo));
-  line_no = line_start_idx + 1;
-  col_no = std::distance(line_start, loc.lo) + 1;
-  len = loc.len();
+  col_no += scan::count_code_points(text + col_lo, text + loc.lo);
+  col_lo = loc.lo;
+  // A span that starts with a continuation byte is still at least one column wide.
+  const uint32_t len = std::max<uint32_t>
+    (scan::count_code_points(text + loc.lo, text + loc.hi()), loc.len > 0);
+  return file_pos(std::distance(lines_begin, line) + 1, col_no, len);
 }
 
+// Append the position of each of `locs`, which must be sorted by their starts, to `out`. This is a
+// single pass over `locs` and the lines that they span.
+//
+// Requires a type that satisfies `lexable` concept.
+void positions(const auto& source, std::span<const span> locs, std::vector<file_pos>& out) {
+  position_cursor cursor(source);
+  out.reserve(out.size() + locs.size());
+  for (const span& loc : locs) {
+    out.push_back(cursor.find(loc));
+  }
+}
+
+inline file_pos::file_pos(const auto& source, const span& loc)
+  : file_pos(position_cursor(source).find(loc)) {}
+
 } // End module namespace.
 
 
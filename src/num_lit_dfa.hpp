@@ -0,0 +1,217 @@
+#ifndef NUM_LIT_DFA_H
+#define NUM_LIT_DFA_H
+#include "error.hpp"
+
+#include <array>
+#include <cstdint>
+
+// A deterministic finite automaton that recognizes numeric literals. The transition table below is
+// written by hand, one row of actions per state over the classes of characters, and must be kept in
+// step with the grammar of literals in the README. Scanning a literal is then a tight loop of one
+// table lookup per character. The scan stops on an action that accepts the literal or rejects it
+// with the `error_type::detail` that describes the first offending character.
+namespace num_lit {
+
+enum state : uint8_t {
+  zero,           // 0
+  dec_int,        // 12
+  dec_int_sep,    // 1_
+  dec_point,      // 1.
+  dec_frac,       // 1.2
+  dec_frac_sep,   // 1.2_
+  exponent,       // 1e, 0x1p
+  exp_digits,     // 1e1, 1e+
+  exp_digits_sep, // 1e1_
+  bin_int,        // 0b1
+  bin_int_sep,    // 0b1_
+  oct_int,        // 0o7
+  oct_int_sep,    // 0o7_
+  hex_int,        // 0xf
+  hex_int_sep,    // 0xf_
+  hex_point,      // 0xf.
+  hex_frac,       // 0xf.f
+  hex_frac_sep,   // 0xf.f_
+
+  num_states // Must stay at end of enum.
+};
+
+// Characters are grouped by the role that they can play in a literal.
+enum char_kind : uint8_t {
+  other,      // Ends the literal.
+  bin_digit,  // 0 1
+  oct_digit,  // 2 .. 7
+  dec_digit,  // 8 9
+  hex_letter, // a c d f A C D F
+  b,          // b B  (binary prefix or hex digit)
+  e,          // e E  (decimal exponent or hex digit)
+  o,          // o O  (octal prefix)
+  x,          // x X  (hex prefix)
+  p,          // p P  (hex exponent)
+  letter,     // Any other letter.
+  sep,        // _
+  point,      // .
+  sign,       // + -
+
+  num_classes // Must stay at end of enum.
+};
+
+constexpr std::array<char_kind, 256> classes = []{
+  std::array<char_kind, 256> classes{};
+  auto set = [&](const char* chars, char_kind cls) {
+    for (; *chars; chars++) {
+      classes[uint8_t(*chars)] = cls;
+    }
+  };
+  set("ghijklmnqrstuvwyzGHIJKLMNQRSTUVWYZ", letter);
+  set("01", bin_digit);
+  set("234567", oct_digit);
+  set("89", dec_digit);
+  set("acdfACDF", hex_letter);
+  set("bB", b);
+  set("eE", e);
+  set("oO", o);
+  set("xX", x);
+  set("pP", p);
+  set("_", sep);
+  set(".", point);
+  set("+-", sign);
+  return classes;
+}();
+
+// An action is either the next state, after consuming the current character, or a final action
+// with the `stop` bit set that leaves the current character unconsumed.
+constexpr uint8_t stop = 0x80;
+constexpr uint8_t reject_bit = 0x40;
+constexpr uint8_t accept_int = stop | 0;
+constexpr uint8_t accept_float = stop | 1;
+
+constexpr uint8_t reject(error_type::detail cause) {
+  return stop | reject_bit | cause;
+}
+
+constexpr error_type::detail rejection_cause(uint8_t action) {
+  return static_cast<error_type::detail>(action & ~(stop | reject_bit));
+}
+
+constexpr auto transitions = []{
+  using enum error_type::detail;
+  using row = std::array<uint8_t, num_classes>;
+  std::array<row, num_states> table{};
+
+  auto on = [](row& r, std::initializer_list<char_kind> chars, uint8_t action) {
+    for (auto cls : chars) {
+      r[cls] = action;
+    }
+  };
+  const auto digits = {bin_digit, oct_digit, dec_digit};
+  const auto hex_digits = {bin_digit, oct_digit, dec_digit, hex_letter, b, e};
+  const auto letters = {hex_letter, b, e, o, x, p, letter};
+  const auto letters_no_e = {hex_letter, b, o, x, p, letter};
+  const auto letters_non_hex_no_p = {o, x, letter};
+
+  // The first digit of a literal that begins with zero may be followed by a radix prefix.
+  table[zero].fill(accept_int);
+  on(table[zero], digits, dec_int);
+  on(table[zero], {sep}, dec_int_sep);
+  on(table[zero], {point}, dec_point);
+  on(table[zero], {b}, bin_int);
+  on(table[zero], {o}, oct_int);
+  on(table[zero], {x}, hex_int);
+  on(table[zero], {hex_letter, e, p, letter}, reject(unknown_radix_prefix));
+
+  table[dec_int].fill(accept_int);
+  on(table[dec_int], digits, dec_int);
+  on(table[dec_int], {sep}, dec_int_sep);
+  on(table[dec_int], {point}, dec_point);
+  on(table[dec_int], {e}, exponent);
+  on(table[dec_int], letters_no_e, reject(non_dec_digit));
+
+  table[dec_int_sep].fill(reject(non_dec_digit));
+  on(table[dec_int_sep], digits, dec_int);
+
+  table[dec_point].fill(reject(missing_fraction_part));
+  on(table[dec_point], digits, dec_frac);
+
+  table[dec_frac].fill(accept_float);
+  on(table[dec_frac], digits, dec_frac);
+  on(table[dec_frac], {sep}, dec_frac_sep);
+  on(table[dec_frac], {e}, exponent);
+  on(table[dec_frac], {point}, reject(multiple_radix_points));
+  on(table[dec_frac], letters_no_e, reject(non_dec_digit));
+
+  table[dec_frac_sep].fill(reject(non_dec_digit));
+  on(table[dec_frac_sep], digits, dec_frac);
+
+  // Hexadecimal floats written in scientific notation still have a decimal exponent. The digits of
+  // an exponent are optional after a sign.
+  table[exponent].fill(reject(missing_exponent));
+  on(table[exponent], digits, exp_digits);
+  on(table[exponent], {sign}, exp_digits);
+  on(table[exponent], letters, reject(non_dec_digit));
+
+  table[exp_digits].fill(accept_float);
+  on(table[exp_digits], digits, exp_digits);
+  on(table[exp_digits], {sep}, exp_digits_sep);
+  on(table[exp_digits], {point}, reject(multiple_radix_points));
+  on(table[exp_digits], letters, reject(non_dec_digit));
+
+  table[exp_digits_sep].fill(reject(non_dec_digit));
+  on(table[exp_digits_sep], digits, exp_digits);
+
+  // Any non-binary alphanumeric character results in an invalid literal.
+  table[bin_int].fill(accept_int);
+  on(table[bin_int], {bin_digit}, bin_int);
+  on(table[bin_int], {sep}, bin_int_sep);
+  on(table[bin_int], {oct_digit, dec_digit}, reject(non_bin_digit));
+  on(table[bin_int], letters, reject(non_bin_digit));
+
+  table[bin_int_sep].fill(reject(non_bin_digit));
+  on(table[bin_int_sep], {bin_digit}, bin_int);
+
+  // Any non-octal alphanumeric character results in an invalid literal.
+  table[oct_int].fill(accept_int);
+  on(table[oct_int], {bin_digit, oct_digit}, oct_int);
+  on(table[oct_int], {sep}, oct_int_sep);
+  on(table[oct_int], {dec_digit}, reject(non_oct_digit));
+  on(table[oct_int], letters, reject(non_oct_digit));
+
+  table[oct_int_sep].fill(reject(non_oct_digit));
+  on(table[oct_int_sep], {bin_digit, oct_digit}, oct_int);
+
+  // Any non-hex alphanumeric character results in an invalid literal.
+  table[hex_int].fill(accept_int);
+  on(table[hex_int], hex_digits, hex_int);
+  on(table[hex_int], {sep}, hex_int_sep);
+  on(table[hex_int], {point}, hex_point);
+  on(table[hex_int], {p}, exponent);
+  on(table[hex_int], letters_non_hex_no_p, reject(non_hex_digit));
+
+  table[hex_int_sep].fill(reject(non_hex_digit));
+  on(table[hex_int_sep], hex_digits, hex_int);
+
+  table[hex_point].fill(reject(missing_fraction_part));
+  on(table[hex_point], hex_digits, hex_frac);
+
+  table[hex_frac].fill(accept_float);
+  on(table[hex_frac], hex_digits, hex_frac);
+  on(table[hex_frac], {sep}, hex_frac_sep);
+  on(table[hex_frac], {p}, exponent);
+  on(table[hex_frac], {point}, reject(multiple_radix_points));
+  on(table[hex_frac], letters_non_hex_no_p, reject(non_hex_digit));
+
+  table[hex_frac_sep].fill(reject(non_hex_digit));
+  on(table[hex_frac_sep], hex_digits, hex_frac);
+
+  // Index rows by byte rather than by character class to save a lookup per character.
+  std::array<std::array<uint8_t, 256>, num_states> by_byte{};
+  for (int state = 0; state < num_states; state++) {
+    for (int ch = 0; ch < 256; ch++) {
+      by_byte[state][ch] = table[state][classes[ch]];
+    }
+  }
+  return by_byte;
+}();
+
+} // End `num_lit` namespace.
+
+#endif
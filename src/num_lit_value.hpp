@@ -0,0 +1,141 @@
+#ifndef NUM_LIT_VALUE_H
+#define NUM_LIT_VALUE_H
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+
+// Decoding of the values of numeric literals that were accepted by the automaton in
+// `num_lit_dfa.hpp`, while the lexer still has their bytes in cache. Digits are converted eight at
+// a time with SWAR (SIMD within a register) arithmetic on little-endian 64-bit words. Every decoder
+// skips the `_` separators that the automaton accepts.
+namespace num_lit {
+
+namespace swar {
+
+constexpr uint64_t repeat(uint64_t pattern, int width) {
+  uint64_t out = 0;
+  for (int shift = 0; shift < 64; shift += width) {
+    out |= pattern << shift;
+  }
+  return out;
+}
+
+constexpr uint64_t ones = repeat(0x01, 8);
+
+// Pack eight digit values of `bits` bits each, one per byte with the most significant first in
+// memory order, into the low `8 * bits` bits of the result. Neighbouring digits are merged into
+// lanes that double in width at each step.
+template <int bits> constexpr uint64_t pack_digits(uint64_t values) {
+  uint64_t v = __builtin_bswap64(values);
+  v = (v | v >> (8 - bits)) & repeat((1 << 2 * bits) - 1, 16);
+  v = (v | v >> (16 - 2 * bits)) & repeat((1 << 4 * bits) - 1, 32);
+  return (v | v >> (32 - 4 * bits)) & ((uint64_t(1) << 8 * bits) - 1);
+}
+
+// The value of eight decimal digits. Pairs of digits are combined with one multiply, and then
+// pairs of pairs with another.
+constexpr uint64_t eight_dec_digits(uint64_t chunk) {
+  uint64_t v = chunk - repeat('0', 8);
+  v = (v * 10) + (v >> 8);
+  return
+    (((v & 0x000000FF000000FF) * (100 + (1000000ULL << 32))) +
+     (((v >> 16) & 0x000000FF000000FF) * (1 + (10000ULL << 32)))) >> 32;
+}
+
+constexpr uint64_t hex_digit_values(uint64_t chunk) {
+  // Letters have bit 6 set and their low nibble is one less than their distance from 9.
+  return (chunk & repeat(0x0F, 8)) + ((chunk >> 6) & ones) * 9;
+}
+
+} // End `swar` namespace.
+
+
+// The value of the integer literal [lo, hi), or nothing if it does not fit in 64 bits.
+inline std::optional<uint64_t> decode_int(const char* lo, const char* hi) {
+  int bits = 0; // Zero for decimal digits.
+  if (hi - lo >= 2 && lo[0] == '0') {
+    switch (lo[1] | 0x20) {
+      case 'b': bits = 1; lo += 2; break;
+      case 'o': bits = 3; lo += 2; break;
+      case 'x': bits = 4; lo += 2; break;
+      default: break;
+    }
+  }
+  while (lo < hi && (*lo == '0' || *lo == '_')) {
+    lo += 1;
+  }
+
+  // Separators are dropped as the digits are copied to a buffer that begins with a chunk of zeros,
+  // so that the first chunk of eight digits can be read whole from right before the digits. Runs
+  // of eight digits without a separator are copied at once. A literal with more significant digits
+  // than the largest 64-bit value does not fit.
+  const size_t max_digits = bits == 0 ? 20 : (64 + bits - 1) / bits;
+  std::array<char, 8 + 64> buffer;
+  std::memset(buffer.data(), '0', 8);
+  char* const digits = buffer.data() + 8;
+  size_t num_digits = 0;
+  const char* p = lo;
+  for (; hi - p >= 8 && max_digits - num_digits >= 8; p += 8) {
+    uint64_t chunk;
+    std::memcpy(&chunk, p, 8);
+    const uint64_t seps = chunk ^ swar::repeat('_', 8);
+    if (((seps - swar::ones) & ~seps & swar::repeat(0x80, 8)) != 0) {
+      break;
+    }
+    std::memcpy(digits + num_digits, p, 8);
+    num_digits += 8;
+  }
+  for (; p < hi; p++) {
+    if (*p == '_') {
+      continue;
+    }
+    if (num_digits == max_digits) {
+      return std::nullopt;
+    }
+    digits[num_digits++] = *p;
+  }
+  const size_t num_chunks = (num_digits + 7) / 8;
+  const char* const padded = digits + num_digits - 8 * num_chunks;
+
+  uint64_t value = 0;
+  for (size_t i = 0; i < num_chunks; i++) {
+    uint64_t chunk;
+    std::memcpy(&chunk, padded + 8 * i, 8);
+    if (bits == 0) {
+      // At most 20 digits, so only the last step can overflow.
+      if (__builtin_mul_overflow(value, 100000000, &value)
+          || __builtin_add_overflow(value, swar::eight_dec_digits(chunk), &value)) {
+        return std::nullopt;
+      }
+      continue;
+    }
+    const int chunk_bits = 8 * bits;
+    if (value >> (64 - chunk_bits) != 0) {
+      return std::nullopt;
+    }
+    switch (bits) {
+      case 1:
+        value = value << 8 | swar::pack_digits<1>(chunk - swar::repeat('0', 8));
+        break;
+      case 3:
+        value = value << 24 | swar::pack_digits<3>(chunk - swar::repeat('0', 8));
+        break;
+      default:
+        value = value << 32 | swar::pack_digits<4>(swar::hex_digit_values(chunk));
+        break;
+    }
+  }
+  return value;
+}
+
+// The double nearest to the value of the float literal [lo, hi), which is infinite if the literal
+// is too large. Decimal literals are converted with the Eisel-Lemire algorithm, which only falls
+// back to `strtod` when more than 19 significant digits leave the rounding undecided. Hex literals
+// are converted exactly.
+double decode_float(const char* lo, const char* hi);
+
+} // End `num_lit` namespace.
+
+#endif
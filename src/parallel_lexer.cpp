@@ -0,0 +1,114 @@
+#include "parallel_lexer.hpp"
+#include "interner.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "doctest.hpp"
+
+#include <bit>
+
+const char* lex_chunk::start() const { return begin; }
+
+bool lex_chunk::has_error() const { return !errors.empty(); }
+
+void lex_chunk::mark_error(error_type kind, const module::span& loc) {
+  errors.emplace_back(std::move(kind), loc);
+}
+
+void lex_chunk::lex() {
+  lexer scanner(*this);
+  // TODO: Refine estimate based on testing. This is the guess of `file::estimate_num_tokens`.
+  tokens.reserve((end - begin) / 10);
+  token_locs.reserve((end - begin) / 10);
+  for (;;) {
+    token cur = scanner.next_token();
+    if (!is_last && cur.loc.lo >= end - begin) {
+      break;
+    }
+    tokens.push_back(cur.kind);
+    token_locs.push_back(cur.loc);
+    if (cur.kind == token::type::ident) {
+      ident_hashes.push_back(scanner.ident_hash());
+    } else if (cur.kind == token::type::int_literal) {
+      literal_values.push_back(scanner.int_value());
+    } else if (cur.kind == token::type::float_literal) {
+      literal_values.push_back(std::bit_cast<uint64_t>(scanner.float_value()));
+    }
+    if (cur.kind == token::type::eof) {
+      break;
+    }
+  }
+  if (!is_last) {
+    // Lexing the token that begins the next chunk may have recorded errors that belong to it.
+    std::erase_if(errors, [&](const auto& err) { return err.second.lo >= end - begin; });
+  }
+}
+
+
+//------------------------------------------------------------------------------------------------//
+#if !defined(DOCTEST_CONFIG_DISABLE)
+TEST_SUITE_BEGIN("lexing");
+
+TEST_CASE("parallel lexing") {
+  std::string text;
+  for (int i = 0; i < 200; i++) {
+    text += "// banner ========\n";
+    text += "  alpha + 0x1.8p3 * (beta - 12_34)\n\n";
+    text += "   0b102 + 1.2.3 $ def extern\t\t";
+    text += (i % 7 == 0) ? "// trailing comment\n" : "\n";
+    text += "\n   \n";
+  }
+  text += "last // no newline at end";
+  text.push_back('\0');
+
+  // A single chunk that is the last behaves exactly like a sequential lexer.
+  lex_chunk sequential(text.data(), text.data() + text.size() - 1, true);
+  sequential.lex();
+  REQUIRE(sequential.has_error());
+  for (size_t i = 0, j = 0; i < sequential.tokens.size(); i++) {
+    if (sequential.tokens[i] == token::type::ident) {
+      const auto name = sequential.token_locs[i].contents(text.data());
+      REQUIRE(sequential.ident_hashes[j++] == interner::hash(name.data(), name.size()));
+    }
+  }
+
+  for (unsigned num_threads : {1u, 2u, 3u, 8u, 64u}) {
+    CAPTURE(num_threads);
+    lex_chunk source(text.data(), text.data() + text.size() - 1, true);
+    std::vector<token::type> tokens;
+    std::vector<module::span> token_locs;
+    std::vector<uint32_t> ident_hashes;
+    std::vector<uint64_t> literal_values;
+    (lex_parallel
+      (source, text.size() - 1, num_threads, 16, tokens, token_locs, ident_hashes, literal_values));
+    CHECK(tokens == sequential.tokens);
+    CHECK(token_locs == sequential.token_locs);
+    CHECK(ident_hashes == sequential.ident_hashes);
+    CHECK(literal_values == sequential.literal_values);
+    CHECK(source.errors == sequential.errors);
+  }
+
+  // A null byte in the middle of the source ends it, along with the errors after it.
+  text[text.size() / 3] = '\0';
+  lex_chunk truncated(text.data(), text.data() + text.size() - 1, true);
+  truncated.lex();
+  REQUIRE(truncated.tokens.back() == token::type::eof);
+  REQUIRE(truncated.token_locs.back().lo == text.size() / 3);
+  for (unsigned num_threads : {1u, 2u, 3u, 8u, 64u}) {
+    CAPTURE(num_threads);
+    lex_chunk source(text.data(), text.data() + text.size() - 1, true);
+    std::vector<token::type> tokens;
+    std::vector<module::span> token_locs;
+    std::vector<uint32_t> ident_hashes;
+    std::vector<uint64_t> literal_values;
+    (lex_parallel
+      (source, text.size() - 1, num_threads, 16, tokens, token_locs, ident_hashes, literal_values));
+    CHECK(tokens == truncated.tokens);
+    CHECK(token_locs == truncated.token_locs);
+    CHECK(ident_hashes == truncated.ident_hashes);
+    CHECK(literal_values == truncated.literal_values);
+    CHECK(source.errors == truncated.errors);
+  }
+}
+
+TEST_SUITE_END();
+#endif
@@ -0,0 +1,138 @@
+#ifndef PARALLEL_LEXER_H
+#define PARALLEL_LEXER_H
+#include "error.hpp"
+#include "lexer.hpp"
+#include "module.hpp"
+#include "token.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// A run of whole lines that is lexed independently of the rest of a source. No token crosses a
+// newline, so lexing each chunk from its first byte produces exactly the tokens that a sequential
+// lexer would, except that spans are offsets from the start of the chunk. Errors are recorded
+// instead of reported so that they can be replayed in source order once every chunk has been
+// lexed. The hash of each identifier is kept for interning, which is done in order afterwards, and
+// so is the value of each literal.
+struct lex_chunk {
+  const char* begin;
+  const char* end; // One past the newline that ends the chunk, or the end of the source.
+  bool is_last;
+  module::line_table line_offsets;
+  std::vector<token::type> tokens;
+  std::vector<module::span> token_locs;
+  std::vector<uint32_t> ident_hashes;
+  std::vector<uint64_t> literal_values;
+  std::vector<std::pair<error_type, module::span>> errors;
+
+  lex_chunk(const char* begin, const char* end, bool is_last)
+    : begin(begin), end(end), is_last(is_last), line_offsets(begin, end - begin) {}
+
+  const char* start() const;
+  bool has_error() const;
+  void mark_error(error_type kind, const module::span& loc);
+
+  void lex();
+};
+static_assert(lexable<lex_chunk>);
+
+
+// Lex the `size` bytes of `source` on up to `num_threads` threads, each of which lexes a chunk of
+// at least `min_chunk_size` bytes. The resulting tokens, their locations, and the order in which
+// errors are reported are identical to those of a sequential lexer. `ident_hashes` receives the
+// hash of every identifier token, and `literal_values` the value of every integer literal and the
+// bits of every float literal, in order.
+template <lexable T>
+void lex_parallel
+  (T& source,
+   size_t size,
+   unsigned num_threads,
+   size_t min_chunk_size,
+   std::vector<token::type>& tokens,
+   std::vector<module::span>& token_locs,
+   std::vector<uint32_t>& ident_hashes,
+   std::vector<uint64_t>& literal_values) {
+  const char* begin = source.start();
+  const char* end = begin + size;
+  const size_t num_chunks =
+    std::max<size_t>(1, std::min<size_t>(num_threads, size / std::max<size_t>(min_chunk_size, 1)));
+
+  // Split after the first newline at or past each evenly spaced target.
+  std::vector<lex_chunk> chunks;
+  const char* chunk_begin = begin;
+  for (size_t i = 1; i < num_chunks; i++) {
+    const char* target = std::max(begin + size * i / num_chunks, chunk_begin);
+    auto newline = static_cast<const char*>(std::memchr(target, '\n', end - target));
+    if (!newline || newline + 1 == end) {
+      break;
+    }
+    chunks.emplace_back(chunk_begin, newline + 1, false);
+    chunk_begin = newline + 1;
+  }
+  chunks.emplace_back(chunk_begin, end, true);
+
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < chunks.size(); i++) {
+    workers.emplace_back(&lex_chunk::lex, &chunks[i]);
+  }
+  chunks[0].lex();
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  workers.clear();
+
+  // A sequential lexer stops at the first null byte of a source, which a chunk lexes as eof. The
+  // chunks after the first one that ends in eof are dropped along with their errors.
+  const auto last_chunk = std::find_if(chunks.begin(), chunks.end(), [](const lex_chunk& chunk) {
+    return !chunk.tokens.empty() && chunk.tokens.back() == token::type::eof;
+  });
+  chunks.erase(last_chunk + 1, chunks.end());
+
+  // Stitch the chunks back together. Copying the token arrays is spread across the same number of
+  // threads because it is a significant fraction of the work when many cores lex.
+  std::vector<size_t> token_starts{0};
+  std::vector<size_t> hash_starts{0};
+  std::vector<size_t> literal_starts{0};
+  for (const auto& chunk : chunks) {
+    token_starts.push_back(token_starts.back() + chunk.tokens.size());
+    hash_starts.push_back(hash_starts.back() + chunk.ident_hashes.size());
+    literal_starts.push_back(literal_starts.back() + chunk.literal_values.size());
+  }
+  tokens.resize(token_starts.back());
+  token_locs.resize(token_starts.back());
+  ident_hashes.resize(hash_starts.back());
+  literal_values.resize(literal_starts.back());
+  auto copy_chunk = [&](size_t i) {
+    const uint32_t chunk_offset = chunks[i].begin - begin;
+    std::copy(chunks[i].tokens.begin(), chunks[i].tokens.end(), tokens.begin() + token_starts[i]);
+    (std::transform
+      (chunks[i].token_locs.begin(), chunks[i].token_locs.end(),
+       token_locs.begin() + token_starts[i],
+       [=](module::span loc) { return module::span(loc.lo + chunk_offset, loc.len); }));
+    (std::copy
+      (chunks[i].ident_hashes.begin(), chunks[i].ident_hashes.end(),
+       ident_hashes.begin() + hash_starts[i]));
+    (std::copy
+      (chunks[i].literal_values.begin(), chunks[i].literal_values.end(),
+       literal_values.begin() + literal_starts[i]));
+  };
+  for (size_t i = 1; i < chunks.size(); i++) {
+    workers.emplace_back(copy_chunk, i);
+  }
+  copy_chunk(0);
+  for (auto& worker : workers) {
+    worker.join();
+  }
+
+  for (const auto& chunk : chunks) {
+    const uint32_t chunk_offset = chunk.begin - begin;
+    for (const auto& [kind, loc] : chunk.errors) {
+      source.mark_error(kind, module::span(loc.lo + chunk_offset, loc.len));
+    }
+  }
+}
+
+#endif
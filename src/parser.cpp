@@ -1,79 +1,522 @@
 #include "parser.hpp"
 #include "module.hpp"
 #include "lexer.hpp"
+#include "parallel_lexer.hpp"
+#include "flat_ast.hpp"
+#include "num_lit_value.hpp"
 #include "token.hpp"
 #include "error.hpp"
 #include "doctest.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdio>
 #include <functional>
 #include <optional>
+#include <random>
+#include <thread>
 #include <tuple>
 #include <fmt/core.h>
 
 namespace parsing {
 
 template <parseable T> void parser<T>::parse() {
-  tokenize();
-  std::unique_ptr<ast::node> root = expression();
-  // Take ownership of `tokens` and `token_locs`.
-  source.abs_syntax = std::make_unique<ast::tree>(std::move(root), this->tokens, this->token_locs);
+  ast::node* root;
+  if (opts.stream_tokens) {
+    ring.emplace(source);
+    root = expression();
+    // The rest of the source is lexed without keeping its tokens, so that its errors are reported
+    // just as they are when the source is lexed before parsing.
+    while (ring->pop().tok.kind != token::type::eof) {}
+    ring.reset();
+  } else {
+    tokenize();
+    kinds = tokens.data();
+    locs = token_locs.data();
+    end_idx = tokens.size() - 1;
+    root = opts.parse_threads > 1 ? parse_parallel() : expression();
+  }
+  // Hand `nodes`, `tokens`, `token_locs`, `token_symbols`, and `literals` to the tree without
+  // copying them.
+  (source.abs_syntax = std::make_unique<ast::tree>
+    (root, std::move(nodes), source.start(), std::move(tokens), std::move(token_locs),
+     std::move(token_symbols), std::move(literals), opts.symbols));
 }
 
+// The lhs of the first operator of every chunk but the first, which is replaced by the expression
+// of the chunks before it.
+static ast::node chunk_lhs(ast::node_type::ident, 0);
+
+// At the top level of an expression, outside of any parentheses, a binary `+` or `-` ends every
+// operator and operand before it, so the tokens between two such operators can be parsed without
+// knowing what came before them. A chunk other than the first is parsed from the operator that
+// begins it, with `chunk_lhs` standing in for its lhs, and the chunks are joined in order by
+// replacing the placeholder of each with the expression so far. The tree is therefore the one that
+// a sequential parse makes.
+//
+// A sequential parse stops at the first token that it cannot use, so chunks after one whose tokens
+// are not all used are dropped, along with their errors. Threads take the next chunk that nobody
+// has taken, so that a thread that finishes early keeps working.
+template <parseable T> ast::node* parser<T>::parse_parallel() {
+  using enum token::type;
+  const size_t min_chunk_size =
+    (std::max<size_t>
+      ({opts.min_parse_chunk_size, tokens.size() / (opts.parse_threads * 4), 1}));
+  std::vector<ast::token_index> starts = {0};
+  int depth = 0;
+  for (ast::token_index i = 0; i < end_idx && depth >= 0; i++) {
+    if (tokens[i] == left_paren) {
+      depth += 1;
+    } else if (tokens[i] == right_paren) {
+      depth -= 1;
+    } else if ((tokens[i] == plus || tokens[i] == dash)
+               && depth == 0
+               && i - starts.back() >= min_chunk_size) {
+      // A `-` after anything but an operand is a negation.
+      const token::type prev = tokens[i - 1];
+      if (prev == ident || prev == int_literal || prev == float_literal || prev == right_paren) {
+        starts.push_back(i);
+      }
+    }
+  }
+  if (starts.size() == 1) {
+    return expression();
+  }
+
+  struct chunk {
+    ast::node* root;
+    ast::arena nodes;
+    std::vector<std::pair<error_type, module::span>> errors;
+    bool is_finished; // Whether every token of the chunk was used.
+  };
+  std::vector<chunk> chunks(starts.size());
+  std::atomic<size_t> next_chunk = 0;
+  auto parse_chunks = [&] {
+    for (size_t i; (i = next_chunk.fetch_add(1)) < chunks.size(); ) {
+      const ast::token_index end = i + 1 < chunks.size() ? starts[i + 1] : end_idx;
+      parser worker(*this, starts[i], end);
+      chunks[i].root =
+        i == 0 ? worker.expression() : worker.parse_precedence(precedence::term, &chunk_lhs);
+      chunks[i].is_finished = worker.idx == end;
+      chunks[i].nodes = std::move(worker.nodes);
+      chunks[i].errors = std::move(worker.deferred_errors);
+    }
+  };
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < std::min<size_t>(opts.parse_threads, chunks.size()); i++) {
+    workers.emplace_back(parse_chunks);
+  }
+  parse_chunks();
+  for (auto& worker : workers) {
+    worker.join();
+  }
+
+  ast::node* root = nullptr;
+  for (auto& cur : chunks) {
+    nodes.splice(std::move(cur.nodes));
+    for (const auto& [kind, loc] : cur.errors) {
+      source.mark_error(kind, loc);
+    }
+    if (&cur == &chunks.front()) {
+      root = cur.root;
+    } else {
+      // The operator that begins the chunk is the deepest on the left edge of its tree.
+      auto* first = static_cast<ast::binop_expr*>(cur.root);
+      while (first->lhs != &chunk_lhs) {
+        first = static_cast<ast::binop_expr*>(first->lhs);
+      }
+      first->lhs = root;
+      root = cur.root;
+    }
+    if (!cur.is_finished) {
+      break;
+    }
+  }
+  return root;
+}
+
+// Every top-level operator on the left edge of a tree is a point at which a parse has used every
+// token before it and holds one operand, which is why `parse_parallel` can begin a chunk at any of
+// them. The tokens that the edit changed are parsed again from the last such operator before them,
+// with the lhs of the old operator in place of `chunk_lhs`. If that parse uses every token up to the
+// first such operator after them, with its parentheses balanced, the rest of the old tree is what a
+// full parse would make of the tokens that follow, and its lowest operator is given the new nodes
+// as its lhs. Otherwise the tokens are parsed again up to the end.
+template <parseable T>
+uint32_t parser<T>::reparse(const module::text_edit& edit) requires editable<T> {
+  using enum token::type;
+  ast::tree& previous = *source.abs_syntax;
+  // A tree made in streaming mode does not keep every token.
+  if (previous.tokens.empty()
+      || previous.tokens.back() != eof
+      || previous.token_symbols.size() != previous.tokens.size()
+      || !previous.symbols) {
+    source.apply_edit(edit);
+    for (error_phase phase : {error_phase::lexing, error_phase::parsing}) {
+      source.discard_errors(phase, {0, uint32_t(source.size()) + 1}, source.num_errors());
+    }
+    parse();
+    return tokens.size();
+  }
+  // The tree only reads its interner, but it is the interner that its parser interned names into.
+  opts.symbols = std::const_pointer_cast<interner>(previous.symbols);
+
+  // The top-level `+` and `-` tokens, up to a `)` that ends the expression. They are found before
+  // the tokens are relexed, so that the tokens of the old tree can be taken instead of copied.
+  std::vector<ast::token_index> top_ops;
+  int depth = 0;
+  for (ast::token_index i = 0; i < previous.tokens.size() && depth >= 0; i++) {
+    const token::type kind = previous.tokens[i];
+    depth += (kind == left_paren) - (kind == right_paren);
+    if ((kind == plus || kind == dash) && depth == 0) {
+      top_ops.push_back(i);
+    }
+  }
+
+  // Tokens from `first_idx` up to `old_end` are replaced by `num_relexed` new ones, which is where
+  // `relex` finds them, and the tokens after them move by `shift`.
+  tokens = std::move(previous.tokens).release();
+  token_locs = std::move(previous.token_locs).release();
+  const size_t old_size = tokens.size();
+  const size_t first_idx =
+    (std::partition_point
+      (token_locs.begin(), token_locs.end(),
+       [&](const module::span& loc) { return loc.hi() < edit.lo; })) - token_locs.begin();
+  const uint32_t num_relexed = relex(source, edit, tokens, token_locs);
+  const size_t old_end = first_idx + num_relexed + old_size - tokens.size();
+  const ast::token_index shift = tokens.size() - old_size; // Wraps around when tokens are removed.
+
+  const auto& old_symbols = previous.token_symbols;
+  const auto& old_literals = previous.literals;
+  token_symbols.assign(old_symbols.begin(), old_symbols.begin() + first_idx);
+  size_t lit = 0;
+  for (; lit < old_literals.tokens.size() && old_literals.tokens[lit] < first_idx; lit++) {
+    literals.push_back(old_literals.tokens[lit], old_literals.values[lit]);
+  }
+  for (ast::token_index i = first_idx; i < first_idx + num_relexed; i++) {
+    const std::string_view lexeme = token_locs[i].contents(source.start());
+    const char* lexeme_end = lexeme.data() + lexeme.size();
+    token_symbols.push_back(tokens[i] == ident ? opts.symbols->intern(lexeme) : interner::no_symbol);
+    if (tokens[i] == int_literal) {
+      literals.push_back(i, *num_lit::decode_int(lexeme.data(), lexeme_end));
+    } else if (tokens[i] == float_literal) {
+      const double value = num_lit::decode_float(lexeme.data(), lexeme_end);
+      literals.push_back(i, std::bit_cast<uint64_t>(value));
+    }
+  }
+  token_symbols.insert(token_symbols.end(), old_symbols.begin() + old_end, old_symbols.end());
+  for (; lit < old_literals.tokens.size(); lit++) {
+    if (old_literals.tokens[lit] >= old_end) {
+      literals.push_back(old_literals.tokens[lit] + shift, old_literals.values[lit]);
+    }
+  }
+  kinds = tokens.data();
+  locs = token_locs.data();
+  end_idx = tokens.size() - 1;
+
+  ast::node* root = previous.root;
+  ast::arena old_nodes = std::move(previous.nodes);
+  uint32_t num_parsed = 0;
+  if (num_relexed > 0 || old_end > first_idx) {
+    // Walk down the left edge from the root to the last operator before the edit.
+    ast::binop_expr* before = nullptr;
+    std::vector<ast::binop_expr*> after; // From the root down.
+    for (ast::node* cur = root;
+         cur
+           && cur->type == ast::node_type::binop_expr
+           && std::binary_search(top_ops.begin(), top_ops.end(), cur->main_token);
+         cur = static_cast<ast::binop_expr*>(cur)->lhs) {
+      auto* op = static_cast<ast::binop_expr*>(cur);
+      if (op->main_token < first_idx) {
+        before = op;
+        break;
+      }
+      if (op->main_token >= old_end) {
+        after.push_back(op);
+      }
+    }
+
+    const ast::token_index lo = before ? before->main_token : 0;
+    ast::token_index hi = end_idx;
+    if (!after.empty()) {
+      hi = after.back()->main_token + shift;
+      depth = 0;
+      for (ast::token_index i = lo; i < hi && depth >= 0; i++) {
+        depth += (tokens[i] == left_paren) - (tokens[i] == right_paren);
+      }
+      // A `-` after anything but an operand is now a negation.
+      const token::type prev = tokens[hi - 1];
+      if (depth != 0
+          || (prev != ident && prev != int_literal && prev != float_literal
+              && prev != right_paren)) {
+        after.clear();
+        hi = end_idx;
+      }
+    }
+    idx = lo;
+    end_idx = hi;
+    defers_errors = true;
+    ast::node* changed = before ? parse_precedence(precedence::term, &chunk_lhs) : expression();
+    defers_errors = false;
+    end_idx = tokens.size() - 1;
+    num_parsed = idx - lo;
+    const bool keeps_tail = !after.empty() && idx == hi;
+
+    // The parse errors of the tokens that were parsed again replace the old ones, which the source
+    // has moved with the text. An error is reported at the token where something was expected, so
+    // those of the new nodes are at most at the operator that begins the tail, and a parse that
+    // runs to the end replaces every error after `lo`.
+    const uint32_t stale_lo = before ? locs[lo].hi() : 0;
+    const uint32_t stale_hi = keeps_tail ? locs[hi].lo + 1 : uint32_t(source.size()) + 1;
+    (source.discard_errors
+      (error_phase::parsing, {stale_lo, stale_hi - stale_lo}, source.num_errors()));
+    for (const auto& [kind, loc] : deferred_errors) {
+      source.mark_error(kind, loc);
+    }
+
+    if (before) {
+      auto* first = static_cast<ast::binop_expr*>(changed);
+      while (first->lhs != &chunk_lhs) {
+        first = static_cast<ast::binop_expr*>(first->lhs);
+      }
+      first->lhs = before->lhs;
+    }
+    // A parse that stops early stops a full parse at the same token.
+    if (!keeps_tail) {
+      root = changed;
+    } else {
+      after.back()->lhs = changed;
+      // Renumber the tokens of the operators after the edit, each of whose lhs is the next one
+      // down, and of every node of their rhs.
+      std::vector<ast::node*> pending;
+      for (ast::binop_expr* op : after) {
+        op->main_token += shift;
+        if (op->rhs && shift != 0) {
+          pending.push_back(op->rhs);
+        }
+      }
+      while (!pending.empty()) {
+        ast::node* cur = pending.back();
+        pending.pop_back();
+        cur->main_token += shift;
+        if (cur->type == ast::node_type::binop_expr) {
+          for (ast::node* child : {static_cast<ast::binop_expr*>(cur)->lhs,
+                                   static_cast<ast::binop_expr*>(cur)->rhs}) {
+            if (child) {
+              pending.push_back(child);
+            }
+          }
+        } else if (cur->type == ast::node_type::unop_expr) {
+          if (ast::node* operand = static_cast<ast::unop_expr*>(cur)->operand) {
+            pending.push_back(operand);
+          }
+        }
+      }
+    }
+  }
+
+  // The nodes that were replaced stay in the arena of the old tree. Every node has a token of its
+  // own, so once the arena is more than twice as large as the nodes of every token would be, the
+  // live nodes are copied to a fresh arena. A tree that is edited again and again then takes memory
+  // in proportion to its source, and the copying costs a constant amount per node made.
+  nodes.splice(std::move(old_nodes));
+  if (nodes.capacity() > max_reparse_arena_size(tokens.size())) {
+    ast::arena live_nodes;
+    root = root ? ast::unflatten(ast::flatten(root), live_nodes) : nullptr;
+    nodes = std::move(live_nodes);
+  }
+  (source.abs_syntax = std::make_unique<ast::tree>
+    (root, std::move(nodes), source.start(), std::move(tokens), std::move(token_locs),
+     std::move(token_symbols), std::move(literals), opts.symbols));
+  return num_parsed;
+}
+
+// Every identifier token is given its symbol, and every other token `interner::no_symbol`. The
+// value of every literal is added to `literals`.
 template <parseable T> void parser<T>::tokenize() {
-  lexer scanner(source);
-  uint32_t estimated_token_count = source.estimate_num_tokens();
-  std::vector<token::type> tokens;
-  std::vector<module::span> token_locs;
-  tokens.reserve(estimated_token_count);
-  token_locs.reserve(estimated_token_count);
+  interner& symbols = *opts.symbols;
+  if (opts.lex_threads > 1) {
+    // Interning is done in order once every chunk has been lexed, since an interner is not shared
+    // between threads.
+    std::vector<uint32_t> ident_hashes;
+    std::vector<uint64_t> literal_values;
+    (lex_parallel
+      (source, source.size(), opts.lex_threads, opts.min_lex_chunk_size,
+       tokens, token_locs, ident_hashes, literal_values));
+    token_symbols.resize(tokens.size(), interner::no_symbol);
+    for (size_t i = 0, j = 0, k = 0; i < tokens.size(); i++) {
+      if (tokens[i] == token::type::ident) {
+        const auto name = token_locs[i].contents(source.start());
+        token_symbols[i] = symbols.intern(name, ident_hashes[j++]);
+      } else if (tokens[i] == token::type::int_literal || tokens[i] == token::type::float_literal) {
+        literals.push_back(i, literal_values[k++]);
+      }
+    }
+  } else {
+    lexer scanner(source);
+    uint32_t estimated_token_count = source.estimate_num_tokens();
+    tokens.reserve(estimated_token_count);
+    token_locs.reserve(estimated_token_count);
+    token_symbols.reserve(estimated_token_count);
 
-  token cur;
-  do {
-    cur = scanner.next_token();
-    fmt::print("{:<8} {}\n", module::file_pos(source, cur.loc), cur);
-    tokens.push_back(cur.kind);
-    token_locs.push_back(cur.loc);
-  } while (cur.kind != token::type::eof);
+    token cur;
+    do {
+      cur = scanner.next_token();
+      (keep
+        (cur, scanner.ident_hash(),
+         cur.kind == token::type::float_literal
+           ? std::bit_cast<uint64_t>(scanner.float_value())
+           : scanner.int_value()));
+    } while (cur.kind != token::type::eof);
+  }
 
-  this->tokens = std::move(tokens);
-  this->token_locs = std::move(token_locs);
+  if (opts.print_tokens) {
+    print_tokens();
+  }
 }
 
-template <parseable T> void parser<T>::expect(token::type expected_tok) {
-  if (tokens[idx] == expected_tok) {
+// Add `cur` to the tokens that the tree keeps, along with its symbol if it is an identifier and
+// its value if it is a literal.
+template <parseable T>
+void parser<T>::keep(const token& cur, uint32_t ident_hash, uint64_t value) {
+  tokens.push_back(cur.kind);
+  token_locs.push_back(cur.loc);
+  (token_symbols.push_back
+    (cur.kind == token::type::ident
+       ? opts.symbols->intern(cur.lexeme(source.start()), ident_hash)
+       : interner::no_symbol));
+  if (cur.kind == token::type::int_literal || cur.kind == token::type::float_literal) {
+    literals.push_back(tokens.size() - 1, value);
+  }
+}
+
+// Tokens are formatted into a buffer that is written out whenever it fills, rather than with a
+// call to `fmt::print` for each one. Their positions are found in one pass over the line table.
+template <parseable T> void parser<T>::print_tokens() const {
+  constexpr size_t flush_size = 1 << 16;
+  fmt::memory_buffer out;
+  module::position_cursor cursor(source);
+  for (size_t i = 0; i < tokens.size(); i++) {
+    token cur(tokens[i], token_locs[i]);
+    (fmt::format_to
+      (std::back_inserter(out), "{:<8} {:<13} '{}'\n",
+       cursor.find(cur.loc), cur.kind, cur.lexeme(source.start())));
+    if (out.size() >= flush_size) {
+      std::fwrite(out.data(), 1, out.size(), stdout);
+      out.clear();
+    }
+  }
+  std::fwrite(out.data(), 1, out.size(), stdout);
+}
+
+template <parseable T>
+void parser<T>::mark_error(error_type kind, const module::span& loc) {
+  if (defers_errors) {
+    deferred_errors.emplace_back(kind, loc);
+  } else {
+    source.mark_error(kind, loc);
+  }
+}
+
+// The kind of the next token.
+template <parseable T> token::type parser<T>::peek() {
+  if (ring) {
+    return ring->peek().tok.kind;
+  }
+  return idx < end_idx ? kinds[idx] : token::type::eof;
+}
+
+// Consume the next token, which a node refers to, and return its index in the tokens of the tree.
+// In streaming mode this is when the token is kept.
+template <parseable T> ast::token_index parser<T>::take() {
+  if (!ring) {
+    return idx++;
+  }
+  const auto next = ring->pop();
+  keep(next.tok, next.ident_hash, next.value);
+  return tokens.size() - 1;
+}
+
+// Consume the next token, which no node refers to.
+template <parseable T> void parser<T>::skip() {
+  if (ring) {
+    ring->pop();
+  } else {
     idx += 1;
+  }
+}
+
+template <parseable T> void parser<T>::expect(token::type expected_tok) {
+  if (peek() == expected_tok) {
+    skip();
   } else {
-    (source.mark_error
+    (mark_error
       ({.tag = error_type::reason::expected_token, .token = expected_tok},
-       token_locs[idx]));
+       ring ? ring->peek().tok.loc : locs[idx]));
   }
 }
 
-template <parseable T> std::unique_ptr<ast::node> parser<T>::expression() {
+template <parseable T> ast::node* parser<T>::expression() {
   return parse_precedence(precedence::term);
 }
 
+// Operands and operators are parsed in a loop rather than by recursion, so that the depth of the
+// tree is bounded by memory instead of by the native stack. Where a recursive parser would call
+// itself for the operand of an operator or the contents of parentheses, a frame is pushed, and it
+// is finished once that operand has been parsed. If `lhs` is given, it is the first operand, and
+// parsing begins with the operator after it.
 template <parseable T>
-std::unique_ptr<ast::node> parser<T>::parse_precedence(precedence min_prec) {
-  const auto& prefix_rule = rules[tokens[idx]];
-  // fmt::print("token of prefix rule: {}\n", tokens[idx]);
-  if (prefix_rule.prefix_action) {
-    std::unique_ptr<ast::node> prefix_node = std::invoke(prefix_rule.prefix_action, this);
-    while (static_cast<uint8_t>(rules[tokens[idx]].prec) >= static_cast<uint8_t>(min_prec)) {
-      const auto& infix_rule = rules[tokens[idx]];
-      std::unique_ptr<ast::node> infix_node = std::invoke(infix_rule.infix_action, this);
-      auto binop = (ast::binop_expr*)infix_node.release();
-      binop->lhs = std::move(prefix_node);
-      prefix_node = std::unique_ptr<ast::binop_expr>(binop);
-    }
-    return prefix_node;
+ast::node* parser<T>::parse_precedence(precedence min_prec, ast::node* lhs) {
+  const size_t base = frames.size();
+  for (;;) {
+    // Parse an operand, pushing a frame for every prefix operator and parenthesis before it.
+    ast::node* operand = std::exchange(lhs, nullptr);
+    while (!operand && rules[peek()].prefix_action) {
+      operand = std::invoke(rules[peek()].prefix_action, this, min_prec);
+    }
+    bool is_missing = !operand;
+
+    // Extend the operand with operators that bind at least as tightly as `min_prec`. Once none
+    // does, it is the last operand of the innermost frame, and finishing that frame gives an
+    // operand that may be extended in turn. A missing operand is never extended.
+    for (;;) {
+      const auto& infix_rule = rules[peek()];
+      if (!is_missing
+          && infix_rule.infix_action
+          && static_cast<uint8_t>(infix_rule.prec) >= static_cast<uint8_t>(min_prec)) {
+        std::invoke(infix_rule.infix_action, this, operand, min_prec);
+        break;
+      }
+      if (frames.size() == base) {
+        return operand;
+      }
+      const frame top = frames.back();
+      frames.pop_back();
+      min_prec = top.min_prec;
+      operand = finish(top, operand);
+      is_missing = false;
+    }
   }
-  return nullptr;
 }
 
-template <parseable T> std::unique_ptr<ast::node> parser<T>::binary() {
+// Give the operator or group of `top` its last operand, and return the node that it becomes.
+template <parseable T> ast::node* parser<T>::finish(const frame& top, ast::node* operand) {
+  if (!top.node) {
+    expect(token::type::right_paren);
+    return operand;
+  }
+  if (top.node->type == ast::node_type::binop_expr) {
+    static_cast<ast::binop_expr*>(top.node)->rhs = operand;
+  } else {
+    static_cast<ast::unop_expr*>(top.node)->operand = operand;
+  }
+  return top.node;
+}
+
+template <parseable T> void parser<T>::binary(ast::node* lhs, precedence& min_prec) {
   ast::binop oper;
-  token::type tok = tokens[idx];
+  token::type tok = peek();
   switch (tok) {
     case token::type::plus: oper = ast::binop::add; break;
     case token::type::dash: oper = ast::binop::sub; break;
@@ -81,44 +524,40 @@ template <parseable T> std::unique_ptr<ast::node> parser<T>::binary() {
     case token::type::fwd_slash: oper = ast::binop::div; break;
     default: break; // unreachable
   }
-  const auto& op_rule = rules[tok];
-  auto binop = std::make_unique<ast::binop_expr>(oper, idx++);
-  binop->rhs =
-    (parse_precedence
-      (static_cast<precedence>
-        (static_cast<uint8_t>(op_rule.prec) + 1)));
-  return binop;
+  frames.push_back({nodes.make<ast::binop_expr>(oper, take(), lhs), min_prec});
+  min_prec = static_cast<precedence>(static_cast<uint8_t>(rules[tok].prec) + 1);
 }
 
-template <parseable T> std::unique_ptr<ast::node> parser<T>::unary() {
+template <parseable T> ast::node* parser<T>::unary(precedence& min_prec) {
   ast::unop oper;
-  token::type tok = tokens[idx];
+  token::type tok = peek();
   switch (tok) {
     case token::type::dash: oper = ast::unop::neg; break;
     case token::type::bang: oper = ast::unop::logical_not; break;
     default: break; // unreachable
   }
-  return std::make_unique<ast::unop_expr>(oper, idx++, parse_precedence(precedence::unary));
+  frames.push_back({nodes.make<ast::unop_expr>(oper, take()), min_prec});
+  min_prec = precedence::unary;
+  return nullptr;
 }
 
-template <parseable T> std::unique_ptr<ast::node> parser<T>::grouping() {
-  idx += 1; // Consume left paren.
-  std::unique_ptr<ast::node> expr = expression();
-  expect(token::type::right_paren);
-  return expr;
+template <parseable T> ast::node* parser<T>::grouping(precedence& min_prec) {
+  skip(); // Consume left paren.
+  frames.push_back({nullptr, min_prec});
+  min_prec = precedence::term;
+  return nullptr;
 }
 
-template <parseable T> std::unique_ptr<ast::node> parser<T>::var() {
-  return std::make_unique<ast::node>(ast::node_type::ident, idx++);
+template <parseable T> ast::node* parser<T>::var(precedence&) {
+  return nodes.make<ast::node>(ast::node_type::ident, take());
 }
 
-template <parseable T> std::unique_ptr<ast::node> parser<T>::float_literal() {
-  return std::make_unique<ast::float_lit>(idx++);
+template <parseable T> ast::node* parser<T>::float_literal(precedence&) {
+  return nodes.make<ast::float_lit>(take());
 }
 
-template <parseable T> std::unique_ptr<ast::node> parser<T>::int_literal() {
-  // fmt::print("int_literal @ idx: {}\n", idx);
-  return std::make_unique<ast::int_lit>(idx++);
+template <parseable T> ast::node* parser<T>::int_literal(precedence&) {
+  return nodes.make<ast::int_lit>(take());
 }
 
 
@@ -133,26 +572,37 @@ uint32_t parser_test_source::estimate_num_tokens() const {
   return 32;
 }
 
-static void test(const char* source_chars, std::unique_ptr<ast::node> expected) {
+// The nodes of expected trees, which are kept for the whole run.
+static ast::arena expected_nodes;
+
+static void test(const char* source_chars, ast::node* expected) {
   CAPTURE(source_chars);
   parser_test_source source(source_chars);
   parser p(source);
   p.parse();
 
-  // The tokens generated during parsing are able to be copied into `expected_tree` because parser
+  // The tokens generated during parsing are able to be shared with `expected_tree` because parser
   // testcases make the assumption that the lexer is working correctly. Additionally, because the
   // representation used for ASTs does not directly contain any tokens, the result of an equality
   // test is unaffected.
-  ast::tree expected_tree(std::move(expected),
+  ast::tree expected_tree(expected,
+                          {},
+                          p.source.abs_syntax->text,
                           p.source.abs_syntax->tokens,
                           p.source.abs_syntax->token_locs);
   CHECK(*p.source.abs_syntax == expected_tree);
+
+  // A tree parsed in streaming mode indexes fewer tokens, so it is compared by its printed form,
+  // which shows the lexeme of every node.
+  parser_test_source streamed(source_chars);
+  parser(streamed, {.stream_tokens = true}).parse();
+  CHECK(std::string(toString(*streamed.abs_syntax).c_str()) == toString(expected_tree).c_str());
 }
 
 // Reduce the boilerplate that is required to make an AST literal.
 template <typename T, typename ...Args>
 inline auto mk(Args&&... args) {
-  return std::make_unique<T>(std::forward<Args>(args)...);
+  return expected_nodes.make<T>(std::forward<Args>(args)...);
 }
 
 TEST_SUITE_BEGIN("parsing");
@@ -193,6 +643,246 @@ TEST_CASE("expressions") {
       mk<unop_expr>(unop::neg, 2, mk<int_lit>(3))));
 }
 
+TEST_CASE("identifier symbols") {
+  constexpr symbol none = interner::no_symbol;
+  auto symbols = std::make_shared<interner>();
+  for (unsigned lex_threads : {1u, 4u}) {
+    CAPTURE(lex_threads);
+    options opts{.lex_threads = lex_threads, .min_lex_chunk_size = 1, .symbols = symbols};
+    parser_test_source first("alpha + beta\n * alpha");
+    parser(first, opts).parse();
+    CHECK(first.abs_syntax->token_symbols == std::vector<symbol>{0, none, 1, none, 0, none});
+
+    // Sources that share an interner share symbols.
+    parser_test_source second("gamma - (alpha / gamma)");
+    parser(second, opts).parse();
+    (CHECK
+      (second.abs_syntax->token_symbols
+         == std::vector<symbol>{2, none, none, 0, none, 2, none, none}));
+    CHECK(second.abs_syntax->symbols->name(2) == "gamma");
+  }
+  CHECK(symbols->size() == 3);
+}
+
+TEST_CASE("literal table") {
+  for (unsigned lex_threads : {1u, 4u}) {
+    CAPTURE(lex_threads);
+    parser_test_source source("1_000 + 0x10\n * (0b11 - 2.5) / 0o17");
+    parser(source, {.lex_threads = lex_threads, .min_lex_chunk_size = 1}).parse();
+    const auto& literals = source.abs_syntax->literals;
+    CHECK(literals.tokens == std::vector<ast::token_index>{0, 2, 5, 7, 10});
+    CHECK(literals.int_value(0) == 1000);
+    CHECK(literals.int_value(2) == 16);
+    CHECK(literals.int_value(5) == 3);
+    CHECK(literals.float_value(7) == 2.5);
+    CHECK(literals.int_value(10) == 15);
+  }
+}
+
+TEST_CASE("deep nesting") {
+  // Each of these would overflow the native stack of a recursive parser.
+  constexpr size_t depth = 1'000'000;
+  std::string parenthesized = std::string(depth, '(') + "1" + std::string(depth, ')');
+  std::string negated;
+  std::string right_nested;
+  for (size_t i = 0; i < depth; i++) {
+    negated += "- ";
+    right_nested += "x * (";
+  }
+  negated += "1";
+  right_nested += "1" + std::string(depth, ')');
+
+  for (bool stream_tokens : {false, true}) {
+    CAPTURE(stream_tokens);
+    parser_test_source source(parenthesized.c_str());
+    parser(source, {.stream_tokens = stream_tokens}).parse();
+    CHECK(!source.has_error());
+    CHECK(source.abs_syntax->root->type == ast::node_type::int_lit);
+
+    parser_test_source unary_source(negated.c_str());
+    parser(unary_source, {.stream_tokens = stream_tokens}).parse();
+    const ast::flat_tree unary_nodes = ast::flatten(unary_source.abs_syntax->root);
+    CHECK(unary_nodes.size() == depth + 1);
+    CHECK(unary_nodes.types.front() == ast::node_type::int_lit);
+    CHECK(unary_nodes.children.back() == std::array<ast::node_index, 2>{depth - 1, ast::no_node});
+
+    parser_test_source binary_source(right_nested.c_str());
+    parser(binary_source, {.stream_tokens = stream_tokens}).parse();
+    CHECK(!binary_source.has_error());
+    const ast::flat_tree binary_nodes = ast::flatten(binary_source.abs_syntax->root);
+    CHECK(binary_nodes.size() == 2 * depth + 1);
+    CHECK(binary_nodes.children.back() == std::array<ast::node_index, 2>{0, 2 * depth - 1});
+  }
+
+  // A group that is never closed is reported, and its expression is kept.
+  parser_test_source unclosed("((1 + 2) * 3");
+  parser(unclosed).parse();
+  CHECK(unclosed.has_error());
+  CHECK(unclosed.abs_syntax->root->type == ast::node_type::binop_expr);
+}
+
+TEST_CASE("parallel parsing") {
+  // Every token boundary that can be is a chunk boundary, and the tree and errors are those of a
+  // sequential parse, including when the parse stops before the end of the source.
+  std::string generated;
+  for (int i = 0; i < 2000; i++) {
+    const char* terms[] = {"a", "-b * 2", "(c - 1.5)", "!(d / (e + f))", "- -g", "(h + )"};
+    const char* ops[] = {" + ", " - ", " * ", " - -"};
+    generated += terms[i * 7 % 6];
+    generated += ops[i * 5 % 4];
+  }
+  generated += "z";
+  const char* sources[] = {
+    "", "a", "a - b - c - d", "-a * b + -(c - d) / 2 - 3.5 + x", "a + (b - c) - (d",
+    "a + b c + d", "a + (b c) + d - e", "a + ) + b", "a + + b - - c", "a * + b + c",
+    "1 + def + 2", "a + ( ) + b", "( ) + a", "(a + b) + (c $ d) + e", generated.c_str(),
+  };
+  for (const char* text : sources) {
+    CAPTURE(text);
+    parser_test_source sequential(text);
+    parser(sequential).parse();
+    parser_test_source parallel(text);
+    parser(parallel, {.parse_threads = 4, .min_parse_chunk_size = 1}).parse();
+    CHECK(*parallel.abs_syntax == *sequential.abs_syntax);
+    CHECK(parallel.errors == sequential.errors);
+  }
+  parser_test_source stopped("(a b) + c + d");
+  parser(stopped, {.parse_threads = 4, .min_parse_chunk_size = 1}).parse();
+  CHECK(stopped.errors.size() == 1);
+  CHECK(stopped.abs_syntax->root->type == ast::node_type::ident);
+}
+
+TEST_CASE("incremental reparsing") {
+  auto symbols = std::make_shared<interner>();
+  // Errors that are reported again come after those that are kept, so errors are compared in order
+  // of location and then of kind.
+  auto sorted_errors = [](const parser_test_source& source) {
+    auto errors = source.errors;
+    (std::sort
+      (errors.begin(), errors.end(),
+       [](const auto& lhs, const auto& rhs) {
+         return std::pair(lhs.second.lo, lhs.first.tag) < std::pair(rhs.second.lo, rhs.first.tag);
+       }));
+    return errors;
+  };
+  auto check_full_parse = [&](const parser_test_source& edited) {
+    parser_test_source full(std::string(edited.start(), edited.size()).c_str());
+    parser(full, {.symbols = symbols}).parse();
+    const ast::tree& reparsed = *edited.abs_syntax;
+    CHECK(reparsed == *full.abs_syntax);
+    CHECK(reparsed.token_symbols == full.abs_syntax->token_symbols);
+    CHECK(reparsed.literals.tokens == full.abs_syntax->literals.tokens);
+    CHECK(reparsed.literals.values == full.abs_syntax->literals.values);
+    CHECK(sorted_errors(edited) == sorted_errors(full));
+  };
+
+  // Random single-character edits give the tree of a full parse, including edits that unbalance
+  // parentheses or stop the parse early.
+  std::string text;
+  for (int i = 0; i < 300; i++) {
+    const char* terms[] = {"a1", "-b * 2", "(c - 1.5)", "!(d / (e + 0x1f))", "- -g", "h"};
+    text += i == 0 ? "" : i % 3 ? " + " : " - ";
+    text += terms[i * 7 % 6];
+  }
+  parser_test_source edited(text.c_str());
+  parser(edited, {.symbols = symbols}).parse();
+  std::mt19937 rng(11);
+  const std::string_view chars = "ab1.9 +-*/()$";
+  for (int i = 0; i < 400; i++) {
+    const uint32_t lo = rng() % (edited.size() + 1);
+    const uint32_t len = lo < edited.size() ? rng() % 2 : 0;
+    const size_t char_idx = rng() % (chars.size() + 1);
+    const std::string_view replacement = chars.substr(char_idx, char_idx < chars.size());
+    CAPTURE(std::string(edited.start(), edited.size()));
+    CAPTURE(lo);
+    parser(edited, {.symbols = symbols}).reparse({lo, len, replacement});
+    check_full_parse(edited);
+  }
+
+  // An edit in the middle of a long sum parses only the term that it changes, and the nodes before
+  // and after it are the ones from before the edit.
+  std::string sum = "x0";
+  for (int i = 1; i < 1000; i++) {
+    sum += fmt::format(" + x{}", i);
+  }
+  parser_test_source long_sum(sum.c_str());
+  parser(long_sum, {.symbols = symbols}).parse();
+  const ast::node* old_root = long_sum.abs_syntax->root;
+  const ast::node* old_first = long_sum.abs_syntax->root;
+  while (old_first->type == ast::node_type::binop_expr) {
+    old_first = static_cast<const ast::binop_expr*>(old_first)->lhs;
+  }
+  const uint32_t middle = sum.find("x500");
+  CHECK(parser(long_sum, {.symbols = symbols}).reparse({middle, 4, "(y - 2)"}) == 6);
+  check_full_parse(long_sum);
+  const ast::node* first = long_sum.abs_syntax->root;
+  while (first->type == ast::node_type::binop_expr) {
+    first = static_cast<const ast::binop_expr*>(first)->lhs;
+  }
+  CHECK(long_sum.abs_syntax->root == old_root);
+  CHECK(first == old_first);
+  CHECK(long_sum.abs_syntax->root->main_token == 2 * 999 - 1 + 4);
+  CHECK(parser(long_sum, {.symbols = symbols}).reparse({middle + 1, 0, " "}) == 6);
+  check_full_parse(long_sum);
+
+  // Replaced nodes are reclaimed, so the arena of a tree that is edited many times stays bounded.
+  const size_t max_arena_size =
+    parser<parser_test_source>::max_reparse_arena_size(long_sum.abs_syntax->tokens.size());
+  for (int i = 0; i < 5000; i++) {
+    if (i % 2 == 0) {
+      parser(long_sum, {.symbols = symbols}).reparse({middle, 8, "x500"});
+    } else {
+      parser(long_sum, {.symbols = symbols}).reparse({middle, 4, "(y  - 2)"});
+    }
+    REQUIRE(long_sum.abs_syntax->nodes.capacity() <= max_arena_size);
+  }
+  check_full_parse(long_sum);
+
+  // Errors after the edit, in tokens that are neither lexed nor parsed again, are kept.
+  parser_test_source literals("a + b + 0b102 + c + 0x_");
+  parser(literals, {.symbols = symbols}).parse();
+  REQUIRE(literals.errors.size() == 2);
+  CHECK(parser(literals, {.symbols = symbols}).reparse({0, 1, "z"}) == 1);
+  CHECK(literals.has_error());
+  CHECK(literals.errors.size() == 2);
+  check_full_parse(literals);
+
+  parser_test_source unclosed("a + b * 2 + (c - d");
+  parser(unclosed, {.symbols = symbols}).parse();
+  REQUIRE(unclosed.errors.size() == 1);
+  CHECK(unclosed.errors[0].first.tag == error_type::expected_token);
+  CHECK(parser(unclosed, {.symbols = symbols}).reparse({4, 1, "bb"}) == 4);
+  REQUIRE(unclosed.errors.size() == 1);
+  CHECK(unclosed.errors[0].second.lo == 19);
+  check_full_parse(unclosed);
+  // Closing the parenthesis parses the tail again and drops its error.
+  parser(unclosed, {.symbols = symbols}).reparse({19, 0, ")"});
+  CHECK(unclosed.errors.empty());
+  check_full_parse(unclosed);
+}
+
+TEST_CASE("streaming") {
+  constexpr symbol none = interner::no_symbol;
+  using enum token::type;
+  parser_test_source source("-(alpha + (0x10)) * ((beta)) / (2.5 - alpha) $");
+  parser(source, {.stream_tokens = true}).parse();
+  // Parentheses and the end of file are not kept.
+  const ast::tree& tree = *source.abs_syntax;
+  (CHECK
+    (tree.tokens
+       == std::vector<token::type>
+            {dash, ident, plus, int_literal, star, ident, fwd_slash, float_literal, dash, ident}));
+  CHECK(tree.token_locs[3] == module::span(11, 4));
+  (CHECK
+    (tree.token_symbols
+       == std::vector<symbol>{none, 0, none, none, none, 1, none, none, none, 0}));
+  CHECK(tree.literals.tokens == std::vector<ast::token_index>{3, 7});
+  CHECK(tree.literals.int_value(3) == 16);
+  CHECK(tree.literals.float_value(7) == 2.5);
+  // Tokens past the end of the expression are still lexed for their errors.
+  CHECK(source.has_error());
+}
+
 TEST_SUITE_END();
 #endif
 
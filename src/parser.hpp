@@ -4,9 +4,15 @@
 #include "ast.hpp"
 #include "module.hpp"
 #include "error.hpp"
+#include "interner.hpp"
 
+#include <algorithm>
 #include <vector>
 #include <array>
+#include <utility>
+#include <bit>
+#include <memory>
+#include <optional>
 #include <fmt/core.h>
 
 namespace parsing {
@@ -15,10 +21,79 @@ template <typename T>
 concept parseable = lexable<T> && requires(T t, const T& const_t) {
   requires std::same_as<decltype(T::abs_syntax), std::unique_ptr<ast::tree>>;
   { const_t.estimate_num_tokens() } -> std::same_as<uint32_t>;
+  { const_t.size() } -> std::same_as<size_t>;
 };
 
-template <parseable T> class parser;
-template <parseable T> using parser_rule_fn = std::unique_ptr<ast::node> (parser<T>::*)();
+struct options {
+  // The number of threads that lex a source. Sources smaller than `min_lex_chunk_size` bytes per
+  // thread are lexed by fewer threads, so small sources are always lexed sequentially.
+  unsigned lex_threads = 1;
+  size_t min_lex_chunk_size = 1 << 20;
+  // Interns the identifiers of a source. Passing the same interner to the parsers of several
+  // sources gives a name the same symbol in all of them. A parser without one makes its own.
+  std::shared_ptr<interner> symbols;
+  // Print every token to standard output as text once the source is lexed. See `token_dump` for a
+  // binary form that tools can load.
+  bool print_tokens = false;
+  // Lex tokens as the parser asks for them instead of all at once before parsing, and keep only
+  // the tokens that nodes refer to. The tree then indexes the kept tokens, and tokens such as
+  // parentheses are not in it. Takes the place of `lex_threads`.
+  bool stream_tokens = false;
+  // The number of threads that parse a source once it is lexed. The expression of a source is
+  // split between its top-level `+` and `-` operators into chunks of at least
+  // `min_parse_chunk_size` tokens, which are parsed independently and joined in source order.
+  // Ignored in streaming mode.
+  unsigned parse_threads = 1;
+  size_t min_parse_chunk_size = 1 << 18;
+};
+
+// The tokens that a parser in streaming mode has lexed but not yet consumed. A token is copied
+// here with the hash or value that the lexer found for it, since those are only kept by the lexer
+// until it lexes the next token.
+template <lexable T> class token_ring {
+public:
+  struct entry {
+    token tok;
+    uint32_t ident_hash;
+    uint64_t value; // The value of a literal, with a float stored as the bits of a double.
+  };
+
+  static constexpr size_t capacity = 4;
+
+  token_ring(T& source) : scanner(source) {}
+
+  // The token `n` places past the next one to be consumed, where `n` is less than `capacity`.
+  const entry& peek(size_t n = 0) {
+    while (num_entries <= n) {
+      fill();
+    }
+    return entries[(head + n) % capacity];
+  }
+
+  entry pop() {
+    const entry next = peek();
+    head = (head + 1) % capacity;
+    num_entries -= 1;
+    return next;
+  }
+
+private:
+  lexer<T> scanner;
+  std::array<entry, capacity> entries;
+  size_t head = 0;
+  size_t num_entries = 0;
+
+  void fill() {
+    entry& next = entries[(head + num_entries) % capacity];
+    next.tok = scanner.next_token();
+    next.ident_hash = scanner.ident_hash();
+    next.value =
+      next.tok.kind == token::type::float_literal
+        ? std::bit_cast<uint64_t>(scanner.float_value())
+        : scanner.int_value();
+    num_entries += 1;
+  }
+};
 
 enum class precedence {
   none,
@@ -27,12 +102,20 @@ enum class precedence {
   unary,  // -
 };
 
+template <parseable T> class parser;
+// A prefix action either returns the node of an operand, or begins an operator or group whose
+// operand is still to be parsed and returns nullptr. An infix action begins an operator whose lhs
+// is its first argument. An action that begins something sets its second argument to the
+// precedence of the operand that follows.
+template <parseable T> using prefix_rule_fn = ast::node* (parser<T>::*)(precedence&);
+template <parseable T> using infix_rule_fn = void (parser<T>::*)(ast::node*, precedence&);
+
 
 // The parsing rule associated with each token when it begins an expression or acts as a
 // binary operator.
 template <parseable T> struct rule {
-  parser_rule_fn<T> prefix_action;
-  parser_rule_fn<T> infix_action;
+  prefix_rule_fn<T> prefix_action;
+  infix_rule_fn<T> infix_action;
   precedence prec;
 
   constexpr rule() : prefix_action(nullptr), infix_action(nullptr), prec(precedence::none) {}
@@ -46,25 +129,88 @@ template <parseable T> class parser {
   public:
     T& source;
 
-    parser (T& source) : source(source), idx(0) {}
+    parser (T& source, options opts = {}) : source(source), opts(opts), idx(0) {
+      if (!this->opts.symbols) {
+        this->opts.symbols = std::make_shared<interner>();
+      }
+    }
 
     void parse();
-    std::unique_ptr<ast::node> expression();
+    ast::node* expression();
+    // Apply `edit` to the source and update its tree, which must be one that a parser made of the
+    // source before the edit with every token lexed first. Only the top-level terms of the
+    // expression that the edit touches, which are the runs of tokens between the `+` and `-`
+    // operators outside of any parentheses, are parsed again. The nodes before and after them are
+    // reused as they are, with the tokens of those after them renumbered. The nodes that are
+    // replaced stay in the tree's arena until it grows past `max_reparse_arena_size`, when the live
+    // nodes are copied to a new arena instead of being reused. New names are interned into the
+    // interner of the tree. The token arrays of the old tree are taken rather than copied unless a
+    // slice of them is held elsewhere. Returns the number of tokens that were parsed again.
+    //
+    // The errors of the tokens that are lexed or parsed again are reported again, and the errors of
+    // the rest of the source are kept, moved with the text, so the source has the errors of a full
+    // parse.
+    uint32_t reparse(const module::text_edit& edit) requires editable<T>;
+    // The size that the arena of a tree of `num_tokens` tokens may grow to as it is reparsed before
+    // its live nodes are copied to a fresh arena.
+    static constexpr size_t max_reparse_arena_size(size_t num_tokens) {
+      return std::max(2 * num_tokens * sizeof(ast::binop_expr), size_t(64) << 10);
+    }
 
   private:
+    options opts;
     ast::token_index idx;
     std::vector<token::type> tokens;
     std::vector<module::span> token_locs;
+    std::vector<symbol> token_symbols;
+    ast::literal_table literals;
+    ast::arena nodes;
+    std::optional<token_ring<T>> ring; // Only in streaming mode.
+    // The tokens that `peek` and `expect` read, which are those of the parser that lexed them, and
+    // the index past the last token to parse. Tokens from `end_idx` on read as the end of file.
+    const token::type* kinds = nullptr;
+    const module::span* locs = nullptr;
+    ast::token_index end_idx = 0;
+    // A parser of one chunk of a source records its errors, to be reported in source order once
+    // every chunk has been parsed.
+    bool defers_errors = false;
+    std::vector<std::pair<error_type, module::span>> deferred_errors;
+
+    // An operator that is waiting for its last operand, or a group that is waiting for its
+    // expression, which is where a recursive parser would have a call on its stack.
+    struct frame {
+      ast::node* node;      // The operator, or nullptr for a group.
+      precedence min_prec;  // The precedence of the expression that the frame is part of.
+    };
+    std::vector<frame> frames;
+
+    // A parser of the tokens from `begin` to `end` of `owner`, on a thread of its own.
+    parser(const parser& owner, ast::token_index begin, ast::token_index end)
+      : source(owner.source),
+        opts(owner.opts),
+        idx(begin),
+        kinds(owner.kinds),
+        locs(owner.locs),
+        end_idx(end),
+        defers_errors(true) {}
 
     void tokenize();
+    ast::node* parse_parallel();
+    void mark_error(error_type kind, const module::span& loc);
+    void keep(const token& cur, uint32_t ident_hash, uint64_t value);
+    void print_tokens() const;
+    token::type peek();
+    ast::token_index take();
+    void skip();
     void expect(token::type);
-    std::unique_ptr<ast::node> parse_precedence(precedence min_prec);
-    std::unique_ptr<ast::node> binary();
-    std::unique_ptr<ast::node> unary();
-    std::unique_ptr<ast::node> grouping();
-    std::unique_ptr<ast::node> var();
-    std::unique_ptr<ast::node> int_literal();
-    std::unique_ptr<ast::node> float_literal();
+    ast::node* parse_precedence(precedence min_prec, ast::node* lhs = nullptr);
+    ast::node* finish(const frame& top, ast::node* operand);
+    void binary(ast::node* lhs, precedence& min_prec);
+    ast::node* unary(precedence& min_prec);
+    ast::node* grouping(precedence& min_prec);
+    ast::node* var(precedence&);
+    ast::node* int_literal(precedence&);
+    ast::node* float_literal(precedence&);
 
     // Essentially a C99 designated initializer of the form `{ [<enum-tag>] = <val>, ... }`.
     static constexpr auto rules = []{
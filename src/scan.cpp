@@ -0,0 +1,488 @@
+#include "scan.hpp"
+#include "char_class.hpp"
+
+#include <array>
+#include <cstddef>
+
+#if defined(__x86_64__)
+#define SCAN_X86
+#include <immintrin.h>
+#endif
+
+namespace scan {
+
+namespace {
+
+struct kernel_set {
+  const char* (*skip_whitespace)(const char*);
+  const char* (*find_line_end)(const char*);
+  const char* (*find_ident_end)(const char*);
+  void (*find_line_starts)(const char*, const char*, std::vector<uint32_t>&);
+  uint32_t (*count_code_points)(const char*, const char*);
+};
+
+// Append the offset from `base` of the byte following each newline whose bit is set in `newlines`;
+// bit `i` corresponds to `block[i]`.
+inline void push_newlines
+  (const char* base,
+   const char* block,
+   uint64_t newlines,
+   std::vector<uint32_t>& line_starts) {
+  while (newlines) {
+    line_starts.push_back(uint32_t(block - base) + __builtin_ctzll(newlines) + 1);
+    newlines &= newlines - 1;
+  }
+}
+
+//------------------------------------------------------------------------------------------------//
+const char* skip_whitespace_scalar(const char* pos) {
+  for (;;) {
+    switch (*pos) {
+      case '\n':
+      case ' ':
+      case '\t':
+      case '\r':
+      case '\f':
+      case '\v':
+        pos += 1;
+        break;
+      default:
+        return pos;
+    }
+  }
+}
+
+const char* find_line_end_scalar(const char* pos) {
+  while (*pos != '\n' && *pos != '\0') {
+    pos += 1;
+  }
+  return pos;
+}
+
+const char* find_ident_end_scalar(const char* pos) {
+  while (char_class::is(*pos, char_class::ident)) {
+    pos += 1;
+  }
+  return pos;
+}
+
+void find_line_starts_scalar
+  (const char* pos,
+   const char* end,
+   std::vector<uint32_t>& line_starts) {
+  for (const char* cur = pos; cur < end; cur++) {
+    if (*cur == '\n') {
+      line_starts.push_back(cur + 1 - pos);
+    }
+  }
+}
+
+uint32_t count_code_points_scalar(const char* pos, const char* end) {
+  uint32_t count = 0;
+  for (; pos < end; pos++) {
+    count += (uint8_t(*pos) & 0xC0) != 0x80;
+  }
+  return count;
+}
+
+#if defined(SCAN_X86)
+//------------------------------------------------------------------------------------------------//
+// The characters '\t' through '\r' are contiguous, so whitespace is either a space or a byte whose
+// distance from '\t' is at most `'\r' - '\t'` when compared as an unsigned integer.
+
+const char* skip_whitespace_sse2(const char* pos) {
+  const __m128i space = _mm_set1_epi8(' ');
+  const __m128i tab = _mm_set1_epi8('\t');
+  const __m128i ctrl_range = _mm_set1_epi8('\r' - '\t');
+  const uintptr_t misalignment = reinterpret_cast<uintptr_t>(pos) & 15;
+  const char* block = pos - misalignment;
+  uint32_t in_range = (0xFFFFu << misalignment) & 0xFFFFu;
+  for (;;) {
+    const __m128i bytes = _mm_load_si128(reinterpret_cast<const __m128i*>(block));
+    const __m128i dist = _mm_sub_epi8(bytes, tab);
+    const __m128i is_ctrl = _mm_cmpeq_epi8(_mm_min_epu8(dist, ctrl_range), dist);
+    const __m128i is_ws = _mm_or_si128(is_ctrl, _mm_cmpeq_epi8(bytes, space));
+    const uint32_t non_ws = ~uint32_t(_mm_movemask_epi8(is_ws)) & in_range;
+    if (non_ws) {
+      return block + __builtin_ctz(non_ws);
+    }
+    block += 16;
+    in_range = 0xFFFFu;
+  }
+}
+
+const char* find_line_end_sse2(const char* pos) {
+  const __m128i newline = _mm_set1_epi8('\n');
+  const __m128i zero = _mm_setzero_si128();
+  const uintptr_t misalignment = reinterpret_cast<uintptr_t>(pos) & 15;
+  const char* block = pos - misalignment;
+  uint32_t in_range = (0xFFFFu << misalignment) & 0xFFFFu;
+  for (;;) {
+    const __m128i bytes = _mm_load_si128(reinterpret_cast<const __m128i*>(block));
+    const __m128i is_end =
+      _mm_or_si128(_mm_cmpeq_epi8(bytes, newline), _mm_cmpeq_epi8(bytes, zero));
+    const uint32_t ends = uint32_t(_mm_movemask_epi8(is_end)) & in_range;
+    if (ends) {
+      return block + __builtin_ctz(ends);
+    }
+    block += 16;
+    in_range = 0xFFFFu;
+  }
+}
+
+// Setting bit 5 maps upper case letters onto lower case letters (and no other byte onto a letter),
+// so an identifier character is a letter, a digit, or an underscore after three range checks.
+const char* find_ident_end_sse2(const char* pos) {
+  const __m128i case_bit = _mm_set1_epi8(0x20);
+  const __m128i lower_a = _mm_set1_epi8('a');
+  const __m128i alpha_range = _mm_set1_epi8('z' - 'a');
+  const __m128i zero_char = _mm_set1_epi8('0');
+  const __m128i digit_range = _mm_set1_epi8('9' - '0');
+  const __m128i underscore = _mm_set1_epi8('_');
+  const uintptr_t misalignment = reinterpret_cast<uintptr_t>(pos) & 15;
+  const char* block = pos - misalignment;
+  uint32_t in_range = (0xFFFFu << misalignment) & 0xFFFFu;
+  for (;;) {
+    const __m128i bytes = _mm_load_si128(reinterpret_cast<const __m128i*>(block));
+    const __m128i alpha_dist = _mm_sub_epi8(_mm_or_si128(bytes, case_bit), lower_a);
+    const __m128i digit_dist = _mm_sub_epi8(bytes, zero_char);
+    const __m128i is_ident =
+      _mm_or_si128
+        (_mm_or_si128
+          (_mm_cmpeq_epi8(_mm_min_epu8(alpha_dist, alpha_range), alpha_dist),
+           _mm_cmpeq_epi8(_mm_min_epu8(digit_dist, digit_range), digit_dist)),
+         _mm_cmpeq_epi8(bytes, underscore));
+    const uint32_t non_ident = ~uint32_t(_mm_movemask_epi8(is_ident)) & in_range;
+    if (non_ident) {
+      return block + __builtin_ctz(non_ident);
+    }
+    block += 16;
+    in_range = 0xFFFFu;
+  }
+}
+
+void find_line_starts_sse2
+  (const char* pos,
+   const char* end,
+   std::vector<uint32_t>& line_starts) {
+  const __m128i newline = _mm_set1_epi8('\n');
+  const uintptr_t misalignment = reinterpret_cast<uintptr_t>(pos) & 15;
+  const char* block = pos - misalignment;
+  uint64_t in_range = uint64_t(0xFFFF) << misalignment;
+  for (; block < end; block += 16) {
+    const __m128i bytes = _mm_load_si128(reinterpret_cast<const __m128i*>(block));
+    uint64_t newlines = uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline))) & in_range;
+    if (end - block < 16) {
+      newlines &= (uint64_t(1) << (end - block)) - 1;
+    }
+    push_newlines(pos, block, newlines, line_starts);
+    in_range = uint64_t(0xFFFF);
+  }
+}
+
+// Continuation bytes are 0x80 through 0xBF, which are the signed bytes less than or equal to -65.
+// The range is not known to be followed by a null byte, so loads are unaligned and the bytes after
+// the last whole vector are counted one at a time.
+uint32_t count_code_points_sse2(const char* pos, const char* end) {
+  const __m128i last_continuation = _mm_set1_epi8(-65);
+  uint32_t count = 0;
+  for (; end - pos >= 16; pos += 16) {
+    const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
+    count += __builtin_popcount(_mm_movemask_epi8(_mm_cmpgt_epi8(bytes, last_continuation)));
+  }
+  return count + count_code_points_scalar(pos, end);
+}
+
+//------------------------------------------------------------------------------------------------//
+__attribute__((target("avx2")))
+const char* skip_whitespace_avx2(const char* pos) {
+  const __m256i space = _mm256_set1_epi8(' ');
+  const __m256i tab = _mm256_set1_epi8('\t');
+  const __m256i ctrl_range = _mm256_set1_epi8('\r' - '\t');
+  const uintptr_t misalignment = reinterpret_cast<uintptr_t>(pos) & 31;
+  const char* block = pos - misalignment;
+  uint32_t in_range = 0xFFFFFFFFu << misalignment;
+  for (;;) {
+    const __m256i bytes = _mm256_load_si256(reinterpret_cast<const __m256i*>(block));
+    const __m256i dist = _mm256_sub_epi8(bytes, tab);
+    const __m256i is_ctrl = _mm256_cmpeq_epi8(_mm256_min_epu8(dist, ctrl_range), dist);
+    const __m256i is_ws = _mm256_or_si256(is_ctrl, _mm256_cmpeq_epi8(bytes, space));
+    const uint32_t non_ws = ~uint32_t(_mm256_movemask_epi8(is_ws)) & in_range;
+    if (non_ws) {
+      return block + __builtin_ctz(non_ws);
+    }
+    block += 32;
+    in_range = 0xFFFFFFFFu;
+  }
+}
+
+__attribute__((target("avx2")))
+const char* find_line_end_avx2(const char* pos) {
+  const __m256i newline = _mm256_set1_epi8('\n');
+  const __m256i zero = _mm256_setzero_si256();
+  const uintptr_t misalignment = reinterpret_cast<uintptr_t>(pos) & 31;
+  const char* block = pos - misalignment;
+  uint32_t in_range = 0xFFFFFFFFu << misalignment;
+  for (;;) {
+    const __m256i bytes = _mm256_load_si256(reinterpret_cast<const __m256i*>(block));
+    const __m256i is_end =
+      _mm256_or_si256(_mm256_cmpeq_epi8(bytes, newline), _mm256_cmpeq_epi8(bytes, zero));
+    const uint32_t ends = uint32_t(_mm256_movemask_epi8(is_end)) & in_range;
+    if (ends) {
+      return block + __builtin_ctz(ends);
+    }
+    block += 32;
+    in_range = 0xFFFFFFFFu;
+  }
+}
+
+__attribute__((target("avx2")))
+const char* find_ident_end_avx2(const char* pos) {
+  const __m256i case_bit = _mm256_set1_epi8(0x20);
+  const __m256i lower_a = _mm256_set1_epi8('a');
+  const __m256i alpha_range = _mm256_set1_epi8('z' - 'a');
+  const __m256i zero_char = _mm256_set1_epi8('0');
+  const __m256i digit_range = _mm256_set1_epi8('9' - '0');
+  const __m256i underscore = _mm256_set1_epi8('_');
+  const uintptr_t misalignment = reinterpret_cast<uintptr_t>(pos) & 31;
+  const char* block = pos - misalignment;
+  uint32_t in_range = 0xFFFFFFFFu << misalignment;
+  for (;;) {
+    const __m256i bytes = _mm256_load_si256(reinterpret_cast<const __m256i*>(block));
+    const __m256i alpha_dist = _mm256_sub_epi8(_mm256_or_si256(bytes, case_bit), lower_a);
+    const __m256i digit_dist = _mm256_sub_epi8(bytes, zero_char);
+    const __m256i is_ident =
+      _mm256_or_si256
+        (_mm256_or_si256
+          (_mm256_cmpeq_epi8(_mm256_min_epu8(alpha_dist, alpha_range), alpha_dist),
+           _mm256_cmpeq_epi8(_mm256_min_epu8(digit_dist, digit_range), digit_dist)),
+         _mm256_cmpeq_epi8(bytes, underscore));
+    const uint32_t non_ident = ~uint32_t(_mm256_movemask_epi8(is_ident)) & in_range;
+    if (non_ident) {
+      return block + __builtin_ctz(non_ident);
+    }
+    block += 32;
+    in_range = 0xFFFFFFFFu;
+  }
+}
+
+__attribute__((target("avx2")))
+void find_line_starts_avx2
+  (const char* pos,
+   const char* end,
+   std::vector<uint32_t>& line_starts) {
+  const __m256i newline = _mm256_set1_epi8('\n');
+  const uintptr_t misalignment = reinterpret_cast<uintptr_t>(pos) & 31;
+  const char* block = pos - misalignment;
+  uint64_t in_range = uint64_t(0xFFFFFFFF) << misalignment;
+  for (; block < end; block += 32) {
+    const __m256i bytes = _mm256_load_si256(reinterpret_cast<const __m256i*>(block));
+    uint64_t newlines =
+      uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, newline))) & in_range;
+    if (end - block < 32) {
+      newlines &= (uint64_t(1) << (end - block)) - 1;
+    }
+    push_newlines(pos, block, newlines, line_starts);
+    in_range = uint64_t(0xFFFFFFFF);
+  }
+}
+
+__attribute__((target("avx2,popcnt")))
+uint32_t count_code_points_avx2(const char* pos, const char* end) {
+  const __m256i last_continuation = _mm256_set1_epi8(-65);
+  uint32_t count = 0;
+  for (; end - pos >= 32; pos += 32) {
+    const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pos));
+    (count += __builtin_popcount
+      (_mm256_movemask_epi8(_mm256_cmpgt_epi8(bytes, last_continuation))));
+  }
+  return count + count_code_points_sse2(pos, end);
+}
+
+//------------------------------------------------------------------------------------------------//
+__attribute__((target("avx512f,avx512bw")))
+const char* skip_whitespace_avx512(const char* pos) {
+  const __m512i space = _mm512_set1_epi8(' ');
+  const __m512i tab = _mm512_set1_epi8('\t');
+  const __m512i ctrl_range = _mm512_set1_epi8('\r' - '\t');
+  const uintptr_t misalignment = reinterpret_cast<uintptr_t>(pos) & 63;
+  const char* block = pos - misalignment;
+  uint64_t in_range = ~uint64_t(0) << misalignment;
+  for (;;) {
+    const __m512i bytes = _mm512_load_si512(block);
+    const uint64_t is_ws =
+      _mm512_cmple_epu8_mask(_mm512_sub_epi8(bytes, tab), ctrl_range) |
+      _mm512_cmpeq_epi8_mask(bytes, space);
+    const uint64_t non_ws = ~is_ws & in_range;
+    if (non_ws) {
+      return block + __builtin_ctzll(non_ws);
+    }
+    block += 64;
+    in_range = ~uint64_t(0);
+  }
+}
+
+__attribute__((target("avx512f,avx512bw")))
+const char* find_line_end_avx512(const char* pos) {
+  const __m512i newline = _mm512_set1_epi8('\n');
+  const uintptr_t misalignment = reinterpret_cast<uintptr_t>(pos) & 63;
+  const char* block = pos - misalignment;
+  uint64_t in_range = ~uint64_t(0) << misalignment;
+  for (;;) {
+    const __m512i bytes = _mm512_load_si512(block);
+    const uint64_t ends =
+      _mm512_cmpeq_epi8_mask(bytes, newline) | _mm512_testn_epi8_mask(bytes, bytes);
+    if (ends & in_range) {
+      return block + __builtin_ctzll(ends & in_range);
+    }
+    block += 64;
+    in_range = ~uint64_t(0);
+  }
+}
+
+__attribute__((target("avx512f,avx512bw")))
+const char* find_ident_end_avx512(const char* pos) {
+  const __m512i case_bit = _mm512_set1_epi8(0x20);
+  const __m512i lower_a = _mm512_set1_epi8('a');
+  const __m512i alpha_range = _mm512_set1_epi8('z' - 'a');
+  const __m512i zero_char = _mm512_set1_epi8('0');
+  const __m512i digit_range = _mm512_set1_epi8('9' - '0');
+  const __m512i underscore = _mm512_set1_epi8('_');
+  const uintptr_t misalignment = reinterpret_cast<uintptr_t>(pos) & 63;
+  const char* block = pos - misalignment;
+  uint64_t in_range = ~uint64_t(0) << misalignment;
+  for (;;) {
+    const __m512i bytes = _mm512_load_si512(block);
+    const uint64_t is_ident =
+      (_mm512_cmple_epu8_mask
+        (_mm512_sub_epi8(_mm512_or_si512(bytes, case_bit), lower_a), alpha_range)) |
+      _mm512_cmple_epu8_mask(_mm512_sub_epi8(bytes, zero_char), digit_range) |
+      _mm512_cmpeq_epi8_mask(bytes, underscore);
+    const uint64_t non_ident = ~is_ident & in_range;
+    if (non_ident) {
+      return block + __builtin_ctzll(non_ident);
+    }
+    block += 64;
+    in_range = ~uint64_t(0);
+  }
+}
+
+__attribute__((target("avx512f,avx512bw")))
+void find_line_starts_avx512
+  (const char* pos,
+   const char* end,
+   std::vector<uint32_t>& line_starts) {
+  const __m512i newline = _mm512_set1_epi8('\n');
+  const uintptr_t misalignment = reinterpret_cast<uintptr_t>(pos) & 63;
+  const char* block = pos - misalignment;
+  uint64_t in_range = ~uint64_t(0) << misalignment;
+  for (; block < end; block += 64) {
+    const __m512i bytes = _mm512_load_si512(block);
+    uint64_t newlines = _mm512_cmpeq_epi8_mask(bytes, newline) & in_range;
+    if (end - block < 64) {
+      newlines &= (uint64_t(1) << (end - block)) - 1;
+    }
+    push_newlines(pos, block, newlines, line_starts);
+    in_range = ~uint64_t(0);
+  }
+}
+
+// The last partial vector is read with a masked load, which does not touch the bytes past `end`.
+__attribute__((target("avx512f,avx512bw,popcnt")))
+uint32_t count_code_points_avx512(const char* pos, const char* end) {
+  const __m512i last_continuation = _mm512_set1_epi8(-65);
+  uint32_t count = 0;
+  for (; end - pos >= 64; pos += 64) {
+    const __m512i bytes = _mm512_loadu_si512(pos);
+    count += __builtin_popcountll(_mm512_cmpgt_epi8_mask(bytes, last_continuation));
+  }
+  if (pos < end) {
+    const __mmask64 in_range = (uint64_t(1) << (end - pos)) - 1;
+    const __m512i bytes = _mm512_maskz_loadu_epi8(in_range, pos);
+    (count += __builtin_popcountll
+      (_mm512_mask_cmpgt_epi8_mask(in_range, bytes, last_continuation)));
+  }
+  return count;
+}
+#endif
+
+//------------------------------------------------------------------------------------------------//
+constexpr std::array<kernel_set, 4> kernels = {{
+  {skip_whitespace_scalar, find_line_end_scalar, find_ident_end_scalar, find_line_starts_scalar,
+   count_code_points_scalar},
+#if defined(SCAN_X86)
+  {skip_whitespace_sse2, find_line_end_sse2, find_ident_end_sse2, find_line_starts_sse2,
+   count_code_points_sse2},
+  {skip_whitespace_avx2, find_line_end_avx2, find_ident_end_avx2, find_line_starts_avx2,
+   count_code_points_avx2},
+  {skip_whitespace_avx512, find_line_end_avx512, find_ident_end_avx512, find_line_starts_avx512,
+   count_code_points_avx512},
+#else
+  {skip_whitespace_scalar, find_line_end_scalar, find_ident_end_scalar, find_line_starts_scalar,
+   count_code_points_scalar},
+  {skip_whitespace_scalar, find_line_end_scalar, find_ident_end_scalar, find_line_starts_scalar,
+   count_code_points_scalar},
+  {skip_whitespace_scalar, find_line_end_scalar, find_ident_end_scalar, find_line_starts_scalar,
+   count_code_points_scalar},
+#endif
+}};
+
+isa active_level = detected_isa();
+const kernel_set* active_kernels = &kernels[static_cast<size_t>(active_level)];
+
+} // End unnamed namespace.
+
+
+isa detected_isa() {
+#if defined(SCAN_X86)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+    return isa::avx512;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return isa::avx2;
+  }
+  return isa::sse2;
+#else
+  return isa::scalar;
+#endif
+}
+
+isa active_isa() { return active_level; }
+
+void use_isa(isa level) {
+  active_level = level <= detected_isa() ? level : detected_isa();
+  active_kernels = &kernels[static_cast<size_t>(active_level)];
+}
+
+const char* isa_name(isa level) {
+  switch (level) {
+    case isa::scalar: return "scalar";
+    case isa::sse2: return "sse2";
+    case isa::avx2: return "avx2";
+    case isa::avx512: return "avx512";
+  }
+  return ""; // Unused.
+}
+
+const char* skip_whitespace(const char* pos) {
+  return active_kernels->skip_whitespace(pos);
+}
+
+const char* find_line_end(const char* pos) {
+  return active_kernels->find_line_end(pos);
+}
+
+const char* find_ident_end(const char* pos) {
+  return active_kernels->find_ident_end(pos);
+}
+
+void find_line_starts(const char* pos, const char* end, std::vector<uint32_t>& line_starts) {
+  active_kernels->find_line_starts(pos, end, line_starts);
+}
+
+uint32_t count_code_points(const char* pos, const char* end) {
+  return active_kernels->count_code_points(pos, end);
+}
+
+} // End `scan` namespace.
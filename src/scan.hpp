@@ -0,0 +1,52 @@
+#ifndef SCAN_H
+#define SCAN_H
+#include <cstdint>
+#include <vector>
+
+// Vectorized kernels used by the lexer to skip over bytes that never produce tokens. Every kernel
+// relies on the same contract as `lexer<T>`: the source is terminated by a null byte, so a scan
+// always stops before running off the end of the buffer. Loads are aligned to the vector width,
+// which means that the bytes read past the terminator never cross into another page.
+namespace scan {
+
+// Instruction sets that have a kernel implementation, ordered from least to most capable.
+enum class isa : uint8_t {
+  scalar,
+  sse2,
+  avx2,
+  avx512,
+};
+
+// The most capable instruction set supported by the running CPU.
+isa detected_isa();
+
+// The instruction set whose kernels are currently in use.
+isa active_isa();
+
+// Select the kernels for `level`, or for the detected instruction set if `level` is not supported.
+// The best supported kernels are selected by default; this exists for benchmarks and tests.
+void use_isa(isa level);
+
+const char* isa_name(isa level);
+
+// Return the address of the first byte at or after `pos` that is not one of ' ', '\t', '\n', '\v',
+// '\f', or '\r'.
+const char* skip_whitespace(const char* pos);
+
+// Return the address of the first '\n' or '\0' at or after `pos`.
+const char* find_line_end(const char* pos);
+
+// Return the address of the first byte at or after `pos` that cannot appear in an identifier.
+const char* find_ident_end(const char* pos);
+
+// Append the offset from `pos` of the byte following every '\n' in [pos, end) to `line_starts`.
+// Unlike the other kernels, this one is bounded by `end` rather than by the null terminator.
+void find_line_starts(const char* pos, const char* end, std::vector<uint32_t>& line_starts);
+
+// Return the number of UTF-8 code points that begin in [pos, end), which is the number of bytes
+// that are not continuation bytes (0b10xxxxxx). Like `find_line_starts`, this is bounded by `end`.
+uint32_t count_code_points(const char* pos, const char* end);
+
+} // End `scan` namespace.
+
+#endif
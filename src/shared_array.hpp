@@ -0,0 +1,80 @@
+#ifndef SHARED_ARRAY_H
+#define SHARED_ARRAY_H
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+
+// A read-only view of a range of an array that is shared by reference counting. The array is taken
+// from a vector without copying it, and copying a `shared_array` or slicing it only copies the
+// reference, so the parser, the tree, and any tool that keeps part of the tokens of a source all
+// read the same elements. The elements never change once they are shared, so views can be read
+// from any number of threads at once.
+template <typename T> class shared_array {
+public:
+  shared_array() = default;
+
+  shared_array(std::vector<T>&& elems)
+    : storage(std::make_shared<std::vector<T>>(std::move(elems))),
+      first(storage->data()),
+      count(storage->size()) {}
+
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+  const T* data() const { return first; }
+  const T* begin() const { return first; }
+  const T* end() const { return first + count; }
+  const T& operator[](size_t idx) const { return first[idx]; }
+  const T& front() const { return first[0]; }
+  const T& back() const { return first[count - 1]; }
+
+  operator std::span<const T>() const { return {first, count}; }
+
+  // The `len` elements from `offset` on, which must be within this view. The slice shares the array
+  // of this view and keeps it alive, and its indices count from its own first element.
+  shared_array slice(size_t offset, size_t len) const {
+    shared_array part;
+    part.storage = storage;
+    part.first = first + offset;
+    part.count = len;
+    return part;
+  }
+
+  // Whether `other` views part of the same array.
+  bool shares_storage(const shared_array& other) const {
+    return storage && storage == other.storage;
+  }
+
+  // The elements as a vector that the caller may change, leaving this view empty. The array is
+  // moved out if this is the only view of it and it views the whole array, and copied otherwise.
+  std::vector<T> release() && {
+    std::vector<T> elems;
+    if (storage.use_count() == 1 && count == storage->size()) {
+      elems = std::move(*storage);
+    } else {
+      elems.assign(begin(), end());
+    }
+    storage.reset();
+    first = nullptr;
+    count = 0;
+    return elems;
+  }
+
+private:
+  std::shared_ptr<std::vector<T>> storage; // Only ever read through a view.
+  const T* first = nullptr;
+  size_t count = 0;
+};
+
+template <typename T> bool operator==(const shared_array<T>& lhs, const shared_array<T>& rhs) {
+  return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
+}
+
+template <typename T> bool operator==(const shared_array<T>& lhs, const std::vector<T>& rhs) {
+  return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
+}
+
+#endif
@@ -0,0 +1,273 @@
+#include "stream.hpp"
+#include "lexer.hpp"
+#include "scan.hpp"
+#include "doctest.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <fmt/core.h>
+
+namespace module {
+
+stream::stream(fs::path name, size_t window_size)
+  : name(name),
+    // Room for the two null bytes that `lexer<T>` expects after the contents.
+    buffer(new char[window_size + 2]),
+    window_capacity(window_size) {
+  in = name == "-" ? stdin : std::fopen(name.c_str(), "rb");
+  if (!in) {
+    error::simple_error(fmt::format("unable to open '{}'", name.string()));
+    exit(EXIT_FAILURE);
+  }
+}
+
+stream::~stream() {
+  if (in != stdin) {
+    std::fclose(in);
+  }
+}
+
+const char* stream::start() const { return buffer.get(); }
+
+bool stream::has_error() const { return total_errors > 0; }
+
+uint64_t stream::num_errors() const { return total_errors; }
+
+void stream::mark_error(error_type kind, const span& loc) {
+  total_errors += 1;
+  if (errors.size() == max_stored_errors) {
+    return;
+  }
+  stream_pos pos = position(loc);
+  const char* line_start = start() + loc.lo;
+  while (line_start > start() && line_start[-1] != '\n') {
+    line_start -= 1;
+  }
+  const char* line_end = line_start;
+  while (*line_end != '\n' && *line_end != '\0') {
+    line_end += 1;
+  }
+  errors.push_back({std::move(kind), pos, std::string(line_start, line_end)});
+}
+
+void stream::display_errors(std::FILE* out) const {
+  fmt::text_style err_label, msg, arrow, file_info, caret;
+  if (stderr_has_color()) {
+    err_label = fmt::emphasis::bold | fg(fmt::color::red);
+    msg = fmt::emphasis::bold;
+    arrow = fmt::emphasis::bold | fg(fmt::color::sky_blue);
+    file_info = fmt::emphasis::italic;
+    caret = err_label;
+  }
+  // Matches the layout of `error_context::display`.
+  for (const auto& err : errors) {
+    uint32_t width = std::max<size_t>(4, fmt::formatted_size("{}", err.pos.line_no) + 1);
+    (fmt::print
+      (out,
+       "{} {}\n   {} {}\n{:<{}} |\n{:>{}d} | {}\n{:<{}} | {}\n\n",
+       fmt::format(err_label, "error:"),
+       fmt::format(msg, "{}", err.kind),
+       fmt::format(arrow, "==>"),
+       fmt::format(file_info, "{}:{}:{}", name.string(), err.pos.line_no, err.pos.col_no),
+       "", width,
+       err.pos.line_no, width, err.line,
+       "", width,
+       fmt::format(caret, "{:>{}}", std::string(err.pos.len, '^'), err.pos.col_no)));
+  }
+  if (total_errors > errors.size()) {
+    (fmt::print
+      (out, "{} {} more errors were not shown\n\n",
+       fmt::format(err_label, "error:"), total_errors - errors.size()));
+  }
+}
+
+void stream::lex(const std::function<void(const batch&)>& on_batch) {
+  batch out;
+  size_t num_filled = 0; // Includes the partial line carried over from the previous window.
+  for (;;) {
+    char* window = buffer.get();
+    num_filled += std::fread(window + num_filled, 1, window_capacity - num_filled, in);
+    if (std::ferror(in)) {
+      error::simple_error(fmt::format("unable to read '{}'", name.string()));
+      exit(EXIT_FAILURE);
+    }
+    const bool at_eof = num_filled < window_capacity;
+
+    // End the window after its last newline. The rest of the bytes begin the next window.
+    size_t window_size = num_filled;
+    if (!at_eof) {
+      size_t last_newline = std::string_view(window, num_filled).rfind('\n');
+      if (last_newline == std::string_view::npos) {
+        grow();
+        continue;
+      }
+      window_size = last_newline + 1;
+    }
+    const char overwritten[2] = {window[window_size], window[window_size + 1]};
+    window[window_size] = '\0';
+    window[window_size + 1] = '\0';
+    line_offsets = line_table(window, window_size);
+
+    out.tokens.clear();
+    out.token_locs.clear();
+    lexer scanner(*this);
+    for (token cur = scanner.next_token(); ; cur = scanner.next_token()) {
+      if (cur.kind == token::type::eof && !at_eof) {
+        break;
+      }
+      out.tokens.push_back(cur.kind);
+      out.token_locs.push_back(cur.loc);
+      if (cur.kind == token::type::eof) {
+        break;
+      }
+    }
+    on_batch(out);
+    if (at_eof) {
+      return;
+    }
+
+    window[window_size] = overwritten[0];
+    window[window_size + 1] = overwritten[1];
+    window_offset += window_size;
+    window_line_no += std::count(window, window + window_size, '\n');
+    num_filled -= window_size;
+    std::memmove(window, window + window_size, num_filled);
+  }
+}
+
+uint64_t stream::offset(const span& loc) const {
+  return window_offset + loc.lo;
+}
+
+stream_pos stream::position(const span& loc) const {
+  auto iter = std::upper_bound(line_offsets.begin(), line_offsets.end(), loc.lo);
+  uint64_t line_idx = std::distance(line_offsets.begin(), iter) - 1;
+  // Columns and lengths are code points, as those of `file_pos` are.
+  const char* line_start = start() + line_offsets[line_idx];
+  return {
+    window_line_no + line_idx,
+    uint64_t(scan::count_code_points(line_start, start() + loc.lo)) + 1,
+    std::max<uint32_t>(scan::count_code_points(start() + loc.lo, start() + loc.hi()), loc.len > 0),
+  };
+}
+
+size_t stream::capacity() const { return window_capacity; }
+
+void stream::grow() {
+  std::unique_ptr<char[]> larger(new char[2 * window_capacity + 2]);
+  std::memcpy(larger.get(), buffer.get(), window_capacity);
+  buffer = std::move(larger);
+  window_capacity *= 2;
+}
+
+
+//------------------------------------------------------------------------------------------------//
+#if !defined(DOCTEST_CONFIG_DISABLE)
+TEST_SUITE_BEGIN("modules");
+
+TEST_CASE("streaming") {
+  std::string text;
+  for (int i = 0; i < 300; i++) {
+    text += fmt::format("  value_{} + 0x{:x}.8p{} * (b - {}_000) // note {}\n", i, i, i % 9, i, i);
+    if (i % 50 == 0) {
+      text += std::string(150, 'z') + "\n\n";
+    }
+  }
+  text += "0b102 $ tail";
+  const fs::path path = fs::temp_directory_path() / "kal-test-streaming.kal";
+  std::ofstream(path, std::ios::binary) << text;
+
+  // Tokens lexed from the whole file, by offset.
+  file whole(path);
+  std::vector<std::pair<token::type, std::pair<uint64_t, uint64_t>>> expected;
+  {
+    lexer scanner(whole);
+    token cur;
+    do {
+      cur = scanner.next_token();
+      expected.push_back({cur.kind, {cur.loc.lo, cur.loc.hi()}});
+    } while (cur.kind != token::type::eof);
+  }
+
+  for (size_t window_size : {size_t(64), size_t(100), size_t(4096), stream::default_window_size}) {
+    CAPTURE(window_size);
+    stream source(path, window_size);
+    std::vector<std::pair<token::type, std::pair<uint64_t, uint64_t>>> tokens;
+    size_t num_batches = 0;
+    source.lex([&](const stream::batch& batch) {
+      for (size_t i = 0; i < batch.tokens.size(); i++) {
+        const auto& loc = batch.token_locs[i];
+        tokens.push_back({batch.tokens[i], {source.offset(loc), source.offset(loc) + loc.len}});
+      }
+      num_batches += 1;
+    });
+    CHECK(tokens == expected);
+    CHECK(source.has_error());
+    // The window only grows to fit the longest line.
+    CHECK(source.capacity() <= std::max<size_t>(window_size, 256));
+    CHECK(num_batches >= text.size() / source.capacity());
+  }
+  fs::remove(path);
+}
+
+TEST_CASE("stream error positions") {
+  const fs::path path = fs::temp_directory_path() / "kal-test-stream-errors.kal";
+  std::ofstream(path, std::ios::binary) << "a\nb\n\n  c $\nd";
+  stream source(path, 4);
+  std::vector<stream_pos> positions;
+  source.lex([&](const stream::batch& batch) {
+    for (const auto& loc : batch.token_locs) {
+      positions.push_back(source.position(loc));
+    }
+  });
+  REQUIRE(positions.size() == 6);
+  CHECK(positions[0].line_no == 1);
+  CHECK(positions[1].line_no == 2);
+  CHECK(positions[2].line_no == 4);
+  CHECK(positions[2].col_no == 3);
+  CHECK(positions[3].line_no == 4);
+  CHECK(positions[3].col_no == 5);
+  CHECK(positions[4].line_no == 5);
+  CHECK(positions[4].col_no == 1);
+  CHECK(source.has_error());
+  fs::remove(path);
+}
+
+TEST_CASE("stream error limit") {
+  // Three errors on every line, over many windows.
+  const fs::path path = fs::temp_directory_path() / "kal-test-stream-error-limit.kal";
+  {
+    std::ofstream out(path, std::ios::binary);
+    for (int i = 0; i < 2000; i++) {
+      out << "a $ b $ c $ d\n";
+    }
+  }
+  stream source(path, 64);
+  source.lex([](const stream::batch&) {});
+  CHECK(source.has_error());
+  CHECK(source.num_errors() == 6000);
+
+  // Only the first errors are displayed, followed by a count of the rest.
+  std::FILE* out = std::tmpfile();
+  REQUIRE(out);
+  source.display_errors(out);
+  std::string shown(std::ftell(out), '\0');
+  std::rewind(out);
+  CHECK(std::fread(shown.data(), 1, shown.size(), out) == shown.size());
+  std::fclose(out);
+  size_t num_shown = 0;
+  for (size_t pos = 0; (pos = shown.find("error:", pos)) != std::string::npos; pos += 1) {
+    num_shown += 1;
+  }
+  CHECK(num_shown == stream::max_stored_errors + 1);
+  CHECK(shown.find(fmt::format("{} more errors were not shown", 6000 - stream::max_stored_errors))
+          != std::string::npos);
+  CHECK(shown.find(":1:3") != std::string::npos);
+  fs::remove(path);
+}
+
+TEST_SUITE_END();
+#endif
+
+} // End `module` namespace.
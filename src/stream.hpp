@@ -0,0 +1,90 @@
+#ifndef STREAM_H
+#define STREAM_H
+#include "error.hpp"
+#include "module.hpp"
+#include "token.hpp"
+
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace module {
+
+// A position in a stream. Unlike `file_pos`, it is not limited to the first 4GiB of a source.
+struct stream_pos {
+  uint64_t line_no;
+  uint64_t col_no;
+  uint32_t len;
+};
+
+
+// Satisfies `lexable` concept.
+//
+// A source that is read through a refillable window instead of being held in memory, so that
+// inputs of any size can be lexed, including those past the 4GiB limit of `file` and those that
+// arrive over a pipe. Each refill ends the window after its last complete line. No token spans a
+// newline, so every window is lexed as if it were a whole source. The window only grows when a
+// single line does not fit in it, which bounds memory by the longest line rather than by the size
+// of the input.
+struct stream {
+  // The tokens of one window. Their spans are offsets into the window, so they are only valid until
+  // the callback that receives the batch returns; `stream::offset` converts them to stream offsets.
+  struct batch {
+    std::vector<token::type> tokens;
+    std::vector<span> token_locs;
+  };
+
+  static constexpr size_t default_window_size = 1 << 20;
+  // Only the first errors are kept for display, each with a copy of its line, and the rest are
+  // counted. Memory then stays bounded however many errors the input has.
+  static constexpr size_t max_stored_errors = 100;
+
+  fs::path name;            // A name of "-" reads from standard input.
+  line_table line_offsets;  // The lines of the current window.
+
+  stream(fs::path name, size_t window_size = default_window_size);
+  ~stream();
+
+  stream(const stream&) = delete;
+  stream& operator=(const stream&) = delete;
+
+  const char* start() const;
+  bool has_error() const;
+  void mark_error(error_type kind, const span& loc);
+  void display_errors(std::FILE* out = stderr) const;
+  uint64_t num_errors() const;
+
+  // Lex the whole stream, handing the tokens of each window to `on_batch`. The last batch ends with
+  // the EOF token. An error reading the stream is reported and exits, as a failure to open it does.
+  void lex(const std::function<void(const batch&)>& on_batch);
+
+  // The offset from the start of the stream of a span in the current window.
+  uint64_t offset(const span& loc) const;
+  // The position of a span in the current window.
+  stream_pos position(const span& loc) const;
+  // The number of bytes that the window can hold.
+  size_t capacity() const;
+
+private:
+  struct stream_error {
+    error_type kind;
+    stream_pos pos;
+    std::string line; // The window is reused, so the line is kept for display.
+  };
+
+  std::FILE* in;
+  std::unique_ptr<char[]> buffer;
+  size_t window_capacity;
+  uint64_t window_offset = 0;
+  uint64_t window_line_no = 1; // The line number of the first line in the window.
+  std::vector<stream_error> errors; // At most `max_stored_errors`.
+  uint64_t total_errors = 0;
+
+  void grow();
+};
+
+} // End `module` namespace.
+
+#endif
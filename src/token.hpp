@@ -33,7 +33,7 @@ struct token {
   token() = default;
   token(type kind, module::span loc) : kind(kind), loc(std::move(loc)) {}
 
-  std::string_view lexeme() const { return loc.contents(); }
+  std::string_view lexeme(const char* source_start) const { return loc.contents(source_start); }
 
   static const char* category(type kind) {
     switch (kind) {
@@ -59,12 +59,13 @@ struct token {
 };
 
 
-template <> struct fmt::formatter<token>: formatter<string_view> {
+// A token's lexeme is not part of it, so only its kind is formatted.
+template <> struct fmt::formatter<token::type>: formatter<string_view> {
   template <typename FormatContext>
-  auto format(const token& tok, FormatContext& ctx) {
+  auto format(token::type kind, FormatContext& ctx) {
     using enum token::type;
     const char* str;
-    switch (tok.kind) {
+    switch (kind) {
       case ident: str = "IDENTIFIER"; break;
       case int_literal: str = "INT LITERAL"; break;
       case float_literal: str = "FLOAT LITERAL"; break;
@@ -80,9 +81,7 @@ template <> struct fmt::formatter<token>: formatter<string_view> {
       case eof: str = "EOF"; break;
       default: str = "INVALID TOKEN"; break;
     }
-    return
-      (formatter<string_view>::format
-        (fmt::format("{:<13} '{}'", str, tok.lexeme()), ctx));
+    return formatter<string_view>::format(str, ctx);
   }
 };
 
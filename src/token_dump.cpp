@@ -0,0 +1,157 @@
+#include "token_dump.hpp"
+#include "error.hpp"
+#include "lexer.hpp"
+#include "doctest.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <fmt/core.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define OS_POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace token_dump {
+
+//------------------------------------------------------------------------------------------------//
+namespace {
+
+size_t padded_size(size_t num_tokens) {
+  return (num_tokens + 7) / 8 * 8;
+}
+
+size_t file_size(size_t num_tokens) {
+  return sizeof(header) + padded_size(num_tokens) + num_tokens * sizeof(module::span);
+}
+
+[[noreturn]] void bad_token_file(const fs::path& path, std::string_view why) {
+  error::simple_error(fmt::format("'{}' is not a token file: {}", path.string(), why));
+  exit(EXIT_FAILURE);
+}
+
+} // End unnamed namespace.
+
+
+// Each array is already contiguous, so it is written with a single call rather than through a
+// buffer one token at a time.
+bool write
+  (const fs::path& path,
+   std::span<const token::type> tokens,
+   std::span<const module::span> token_locs) {
+  static_assert(sizeof(token::type) == 1 && sizeof(module::span) == 8);
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  const header head = {magic, version, token::type::num_tokens, uint32_t(tokens.size())};
+  const char padding[8] = {};
+  out.write(reinterpret_cast<const char*>(&head), sizeof(head));
+  out.write(reinterpret_cast<const char*>(tokens.data()), tokens.size());
+  out.write(padding, padded_size(tokens.size()) - tokens.size());
+  out.write(reinterpret_cast<const char*>(token_locs.data()), token_locs.size_bytes());
+  out.flush();
+  return bool(out);
+}
+
+reader::reader(const fs::path& path) {
+  const char* contents = nullptr;
+  size_t size = 0;
+#if defined(OS_POSIX)
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    error::simple_error(fmt::format("unable to open '{}'", path.string()));
+    exit(EXIT_FAILURE);
+  }
+  struct stat info;
+  size = fstat(fd, &info) == 0 && S_ISREG(info.st_mode) ? info.st_size : 0;
+  if (size >= sizeof(header)) {
+    // Pages are only read when a tool touches the tokens on them.
+    void* base = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (base != MAP_FAILED) {
+      mapping = base;
+      mapping_size = size;
+      contents = static_cast<const char*>(base);
+    }
+  }
+  close(fd);
+#endif
+  if (!contents) {
+    std::ifstream in_stream(path, std::ios::binary | std::ios::ate);
+    if (!in_stream) {
+      error::simple_error(fmt::format("unable to open '{}'", path.string()));
+      exit(EXIT_FAILURE);
+    }
+    size = in_stream.tellg();
+    in_stream.seekg(0);
+    buffer.reset(new uint64_t[(size + 7) / 8]);
+    in_stream.read(reinterpret_cast<char*>(buffer.get()), size);
+    contents = reinterpret_cast<const char*>(buffer.get());
+  }
+
+  header head;
+  if (size < sizeof(head)) {
+    bad_token_file(path, "it is too small");
+  }
+  std::memcpy(&head, contents, sizeof(head));
+  if (head.magic != magic) {
+    bad_token_file(path, "it does not begin with 'KTOK'");
+  }
+  if (head.version != version || head.num_kinds != token::type::num_tokens) {
+    bad_token_file(path, "it was written by a different version");
+  }
+  if (size < file_size(head.num_tokens)) {
+    bad_token_file(path, "it is truncated");
+  }
+  const char* const kinds_start = contents + sizeof(header);
+  kinds = {reinterpret_cast<const token::type*>(kinds_start), head.num_tokens};
+  (locs = std::span
+    (reinterpret_cast<const module::span*>(kinds_start + padded_size(head.num_tokens)),
+     head.num_tokens));
+}
+
+reader::~reader() {
+#if defined(OS_POSIX)
+  if (mapping) {
+    munmap(mapping, mapping_size);
+  }
+#endif
+}
+
+std::span<const token::type> reader::tokens() const { return kinds; }
+
+std::span<const module::span> reader::token_locs() const { return locs; }
+
+} // End `token_dump` namespace.
+
+
+//------------------------------------------------------------------------------------------------//
+#if !defined(DOCTEST_CONFIG_DISABLE)
+TEST_SUITE_BEGIN("lexing");
+
+TEST_CASE("token dump") {
+  const fs::path path = fs::temp_directory_path() / "kal-test-token-dump.ktok";
+  for (const char* text : {"", "x", "def f(x) x * 0x10 + 2.5 - $ ! (y / z)"}) {
+    CAPTURE(text);
+    lexer_test_source source(text);
+    lexer scanner(source);
+    std::vector<token::type> tokens;
+    std::vector<module::span> token_locs;
+    token cur;
+    do {
+      cur = scanner.next_token();
+      tokens.push_back(cur.kind);
+      token_locs.push_back(cur.loc);
+    } while (cur.kind != token::type::eof);
+
+    REQUIRE(token_dump::write(path, tokens, token_locs));
+    CHECK(fs::file_size(path) == 16 + (tokens.size() + 7) / 8 * 8 + 8 * tokens.size());
+    token_dump::reader dump(path);
+    CHECK(std::vector(dump.tokens().begin(), dump.tokens().end()) == tokens);
+    CHECK(std::vector(dump.token_locs().begin(), dump.token_locs().end()) == token_locs);
+  }
+  fs::remove(path);
+}
+
+TEST_SUITE_END();
+#endif
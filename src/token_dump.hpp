@@ -0,0 +1,62 @@
+#ifndef TOKEN_DUMP_H
+#define TOKEN_DUMP_H
+#include "module.hpp"
+#include "token.hpp"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <span>
+
+// A binary file of the tokens of a source, for tools that want tokens without lexing. The layout
+// is the same as the arrays that the parser keeps, so a reader maps the file and uses its arrays in
+// place:
+//
+//   header   16 bytes
+//   kinds    `num_tokens` bytes, padded with zeros to a multiple of 8 bytes
+//   locs     `num_tokens` `module::span`s of 8 bytes each
+//
+// Integers are in the byte order of the machine that wrote the file. Kinds are only meaningful to
+// a build with the same `token::type` enum, which the header identifies by its number of kinds.
+namespace token_dump {
+
+struct header {
+  std::array<char, 4> magic;
+  uint32_t version;
+  uint32_t num_kinds;
+  uint32_t num_tokens;
+};
+
+constexpr std::array<char, 4> magic = {'K', 'T', 'O', 'K'};
+constexpr uint32_t version = 1;
+
+// Write the tokens to `path`, replacing it. Returns false if the file could not be written.
+bool write
+  (const fs::path& path,
+   std::span<const token::type> tokens,
+   std::span<const module::span> token_locs);
+
+// The tokens of a file written by `write`. A reader that fails to open or check its file reports
+// the error and exits, as `module::file` does.
+class reader {
+public:
+  reader(const fs::path& path);
+  ~reader();
+
+  reader(const reader&) = delete;
+  reader& operator=(const reader&) = delete;
+
+  std::span<const token::type> tokens() const;
+  std::span<const module::span> token_locs() const;
+
+private:
+  std::unique_ptr<uint64_t[]> buffer; // Holds the contents when the file is not mapped.
+  void* mapping = nullptr;            // The address and size of a mapped file.
+  size_t mapping_size = 0;
+  std::span<const token::type> kinds;
+  std::span<const module::span> locs;
+};
+
+} // End `token_dump` namespace.
+
+#endif